@@ -0,0 +1,264 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <asset_matcher.h>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * Match a character against a glob character class
+ *
+ * @param glob		The glob, positioned at the opening [ of the class
+ * @param c		The character
+ * @param matched	Set to true if the character is in the class
+ * @return		The glob after the closing ] of the class or NULL
+ *			if the class is not closed
+ */
+static const char *
+classMatch(const char *glob, char c, bool& matched)
+{
+	const char *p = glob + 1;
+	bool negate = false;
+	if (*p == '!' || *p == '^')
+	{
+		negate = true;
+		p++;
+	}
+	matched = false;
+	bool first = true;
+	while (*p && (first || *p != ']'))
+	{
+		first = false;
+		if (p[1] == '-' && p[2] && p[2] != ']')
+		{
+			if (c >= p[0] && c <= p[2])
+				matched = true;
+			p += 3;
+		}
+		else
+		{
+			if (c == *p)
+				matched = true;
+			p++;
+		}
+	}
+	if (!*p)
+		return NULL;
+	if (negate)
+		matched = !matched;
+	return p + 1;
+}
+
+/**
+ * Destructor for a node of the trie, deletes the nodes below it
+ */
+AssetMatcher::Node::~Node()
+{
+	for (auto& child : m_children)
+	{
+		delete child.second;
+	}
+}
+
+/**
+ * Constructor for the asset matcher
+ */
+AssetMatcher::AssetMatcher() : m_root(new Node)
+{
+}
+
+/**
+ * Destructor for the asset matcher
+ */
+AssetMatcher::~AssetMatcher()
+{
+	delete m_root;
+}
+
+/**
+ * Remove all the patterns
+ */
+void
+AssetMatcher::clear()
+{
+	delete m_root;
+	m_root = new Node;
+	m_regexes.clear();
+}
+
+/**
+ * Return the node of the trie reached by a literal string, adding the
+ * nodes that do not exist
+ *
+ * @param literal	The literal string
+ * @return		The node for the string
+ */
+AssetMatcher::Node *
+AssetMatcher::insert(const string& literal)
+{
+	Node *node = m_root;
+	for (char c : literal)
+	{
+		Node*& child = node->m_children[c];
+		if (!child)
+			child = new Node;
+		node = child;
+	}
+	return node;
+}
+
+/**
+ * Add a pattern. An asset name or prefix that has already been added
+ * takes the new value. A pattern other than a regular expression is
+ * also added as an asset name.
+ *
+ * @param pattern	The pattern
+ * @param value		The value returned when the pattern matches
+ * @return		False if the pattern is an invalid regular expression
+ */
+bool
+AssetMatcher::add(const string& pattern, int value)
+{
+	size_t len = strlen(REGEX_PREFIX);
+	if (pattern.compare(0, len, REGEX_PREFIX) == 0)
+	{
+		try {
+			m_regexes.push_back(make_pair(regex(pattern.substr(len)), value));
+		} catch (const regex_error&) {
+			return false;
+		}
+		return true;
+	}
+
+	// Every pattern also matches the asset of exactly that name, so that
+	// the names of assets that contain *, ? or [ match their own overrides
+	insert(pattern)->m_exact = value;
+
+	size_t wild = pattern.find_first_of("*?[");
+	if (wild == string::npos)
+	{
+		return true;
+	}
+	if (wild == pattern.size() - 1 && pattern[wild] == '*')
+	{
+		insert(pattern.substr(0, wild))->m_prefix = value;
+	}
+	else
+	{
+		insert(pattern.substr(0, wild))->m_globs.push_back(make_pair(pattern.substr(wild), value));
+	}
+	return true;
+}
+
+/**
+ * Find the pattern that matches an asset name
+ *
+ * @param asset		The asset name
+ * @return		The value of the pattern or MATCH_NONE if no
+ *			pattern matches
+ */
+int
+AssetMatcher::match(const string& asset) const
+{
+	int best = MATCH_NONE;
+	const Node *node = m_root;
+	size_t i = 0;
+	while (node)
+	{
+		// The patterns found deeper in the trie have longer literal parts
+		if (node->m_prefix != MATCH_NONE)
+			best = node->m_prefix;
+		for (const auto& g : node->m_globs)
+		{
+			if (globMatch(g.first.c_str(), asset.c_str() + i))
+			{
+				best = g.second;
+				break;
+			}
+		}
+		if (i == asset.size())
+		{
+			if (node->m_exact != MATCH_NONE)
+				return node->m_exact;
+			break;
+		}
+		auto child = node->m_children.find(asset[i++]);
+		node = (child == node->m_children.end()) ? NULL : child->second;
+	}
+	if (best != MATCH_NONE)
+		return best;
+
+	for (const auto& r : m_regexes)
+	{
+		if (regex_match(asset, r.first))
+			return r.second;
+	}
+	return MATCH_NONE;
+}
+
+/**
+ * Match a name against a glob. A * matches any sequence of characters,
+ * a ? any single character and [...] any character in the class.
+ *
+ * @param glob		The glob
+ * @param name		The name
+ * @return		True if the whole name matches the glob
+ */
+bool
+AssetMatcher::globMatch(const char *glob, const char *name)
+{
+	const char *star = NULL;
+	const char *resume = NULL;
+	while (*name)
+	{
+		bool matched = false;
+		const char *next = glob + 1;
+		if (*glob == '*')
+		{
+			star = glob++;
+			resume = name;
+			continue;
+		}
+		if (*glob == '?')
+		{
+			matched = true;
+		}
+		else if (*glob == '[')
+		{
+			next = classMatch(glob, *name, matched);
+			if (!next)
+			{
+				// A [ that does not start a class is matched literally
+				matched = (*name == '[');
+				next = glob + 1;
+			}
+		}
+		else if (*glob)
+		{
+			matched = (*glob == *name);
+		}
+		if (matched)
+		{
+			glob = next;
+			name++;
+		}
+		else if (star)
+		{
+			// Let the last * match one more character
+			glob = star + 1;
+			name = ++resume;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (*glob == '*')
+		glob++;
+	return *glob == 0;
+}
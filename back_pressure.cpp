@@ -0,0 +1,115 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <back_pressure.h>
+#include <logger.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Constructor for the back pressure detection. Back pressure
+ * handling is disabled until a threshold is configured.
+ */
+BackPressure::BackPressure() : m_threshold(0.0), m_factor(1.0), m_scale(1.0),
+	m_latency(-1.0), m_interval(-1.0), m_first(true), m_shed(0), m_totalShed(0)
+{
+}
+
+/**
+ * Configure the back pressure handling
+ *
+ * @param threshold	The downstream latency in milliseconds above which
+ *			tolerances are scaled up, 0 disables the handling
+ * @param factor	The factor by which to scale the tolerances
+ */
+void
+BackPressure::configure(double threshold, double factor)
+{
+	m_threshold = threshold;
+	m_factor = factor < 1.0 ? 1.0 : factor;
+	if (m_threshold <= 0.0)
+	{
+		m_scale = 1.0;
+	}
+	else if (m_scale > m_factor)
+	{
+		m_scale = m_factor;
+	}
+}
+
+/**
+ * Record the arrival of a new batch of readings
+ */
+void
+BackPressure::arrival()
+{
+	steady_clock::time_point now = steady_clock::now();
+	if (!m_first)
+	{
+		double interval = duration<double>(now - m_lastArrival).count();
+		if (m_interval < 0.0)
+			m_interval = interval;
+		else
+			m_interval += BACKPRESSURE_SMOOTHING * (interval - m_interval);
+	}
+	m_first = false;
+	m_lastArrival = now;
+}
+
+/**
+ * Return the average rate at which batches of readings arrive
+ *
+ * @return The number of batches per second
+ */
+double
+BackPressure::getArrivalRate() const
+{
+	if (m_interval <= 0.0)
+		return 0.0;
+	return 1.0 / m_interval;
+}
+
+/**
+ * Record the time taken to pass a batch of readings downstream and
+ * update the tolerance scale accordingly.
+ *
+ * @param milliseconds	The time spent in the downstream elements
+ */
+void
+BackPressure::latency(double milliseconds)
+{
+	if (m_latency < 0.0)
+		m_latency = milliseconds;
+	else
+		m_latency += BACKPRESSURE_SMOOTHING * (milliseconds - m_latency);
+
+	if (m_threshold <= 0.0)
+		return;
+
+	Logger *logger = Logger::getLogger();
+	if (m_latency > m_threshold)
+	{
+		if (m_scale < m_factor)
+		{
+			logger->warn("Downstream latency of %.1lfms exceeds %.1lfms with %.1lf batches per second arriving, scaling tolerances by %.2lf",
+					m_latency, m_threshold, getArrivalRate(), m_factor);
+			m_scale = m_factor;
+		}
+	}
+	else if (m_scale > 1.0)
+	{
+		m_scale = 1.0 + (m_scale - 1.0) * BACKPRESSURE_DECAY;
+		if (m_scale < 1.01)
+		{
+			m_scale = 1.0;
+			logger->info("Downstream latency has recovered to %.1lfms, %lu datapoint values were shed, %lu in total",
+					m_latency, m_shed, m_totalShed);
+			m_shed = 0;
+		}
+	}
+}
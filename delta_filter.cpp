@@ -12,14 +12,18 @@
 #include <config_category.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <strings.h>
 #include <string>
 #include <iostream>
 #include <reading_set.h>
 #include <vector>
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
+#include <chrono>
 
 using namespace std;
 using namespace rapidjson;
@@ -39,9 +43,36 @@ DeltaFilter::DeltaFilter(const std::string& filterName,
                                OUTPUT_HANDLE *outHandle,
                                OUTPUT_STREAM out) :
                                   FledgeFilter(filterName, filterConfig,
-                                                outHandle, out)
+                                                outHandle, out),
+				  m_state(DeltaMap::allocator_type(m_pool)),
+				  m_overrideVersion(0),
+				  m_epoch(chrono::steady_clock::now()),
+				  m_heartbeatThread(NULL),
+				  m_shutdown(false),
+				  m_lruHead(NULL),
+				  m_lruTail(NULL),
+				  m_stateSize(0),
+				  m_evictions(0),
+				  m_expirations(0),
+				  m_segmentHash(0),
+				  m_dirtyHead(NULL),
+				  m_dirtyCount(0),
+				  m_checkpointInterval(0),
+				  m_checkpointThread(NULL),
+				  m_outputDepth(0),
+				  m_outputBatch(0),
+				  m_outputQueue(NULL),
+				  m_outputThread(NULL),
+				  m_batchLimit(0),
+				  m_batch(NULL),
+				  m_flushThread(NULL),
+				  m_flushStop(false),
+				  m_hot(NULL),
+				  m_stateVersion(0),
+				  m_statisticsInterval(0)
 {
         handleConfig(filterConfig);                   
+	configureOutput(m_outputDepth, m_outputBatch, m_outputLatency);
 }
 
 /**
@@ -50,93 +81,1793 @@ DeltaFilter::DeltaFilter(const std::string& filterName,
  */
 DeltaFilter::~DeltaFilter()
 {
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		m_shutdown = true;
+	}
+	if (m_heartbeatThread)
+	{
+		m_heartbeatCV.notify_all();
+		m_heartbeatThread->join();
+		delete m_heartbeatThread;
+	}
+	if (m_checkpointThread)
+	{
+		m_checkpointCV.notify_all();
+		m_checkpointThread->join();
+		delete m_checkpointThread;
+	}
+
+	// Send the readings held back by the maximum rate onwards
+	vector<Reading *> pending;
+	pending.swap(m_released);
+	for (auto& state : m_state)
+	{
+		Reading *reading = state.second->release();
+		if (reading)
+			pending.push_back(reading);
+	}
+	if (!pending.empty())
+		output(new ReadingSet(&pending));
+
+	// Send any readings still batched or queued onwards
+	configureOutput(0, 0, chrono::milliseconds(0));
+
+	if (m_evictions || m_expirations)
+	{
+		Logger::getLogger()->info("Delta filter evicted the state of %lu assets and expired %lu idle assets",
+				m_evictions, m_expirations);
+	}
+
 	// Cleanup memory in m_state pair
 	for (DeltaMap::iterator deltaIt = m_state.begin(); deltaIt != m_state.end(); deltaIt++)
 	{
-		delete deltaIt->second;
+		delete deltaIt->second;
+	}
+}
+
+/**
+ * Filter ingest method, the core of the filter.
+ *
+ * The ingest method is responsible for takign a set of readings in,
+ * applying the rules of the delta file and creating a set of outgoing
+ * readings which are the delta's.
+ *
+ * The incoming readings that are not forwarded will be deleted. The
+ * readings that are forwarded are compacted in place at the start of the
+ * vector, in their original order, and the vector is then truncated, so
+ * no new containers are allocated. If early emission is configured the
+ * readings forwarded so far are sent onwards in chunks while the rest of
+ * a large set is still being evaluated.
+ *
+ * @param readings	The incoming readings from the previous filter in the
+ *			pipeline, on return the readings to forward
+ */
+void DeltaFilter::ingest(vector<Reading *> *readings)
+{
+    size_t forwarded = 0;
+    unsigned long emitCount;
+    chrono::milliseconds emitInterval;
+    bool groupByAsset;
+
+	reportStatistics();
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		m_backPressure.arrival();
+		emitCount = m_emitCount;
+		emitInterval = m_emitInterval;
+		groupByAsset = m_groupByAsset;
+	}
+	if (groupByAsset)
+	{
+		ingestGrouped(readings);
+		return;
+	}
+	chrono::steady_clock::time_point lastEmit = chrono::steady_clock::now();
+    
+	// Iterate over the readings
+	for (vector<Reading *>::const_iterator it = readings->begin();
+					it != readings->end(); it++)
+	{
+		if (forwarded && ((emitCount && forwarded >= emitCount)
+				|| (emitInterval.count()
+					&& chrono::steady_clock::now() - lastEmit >= emitInterval)))
+		{
+			// Send the readings forwarded so far before evaluating the rest
+			emit(readings, forwarded);
+			forwarded = 0;
+			lastEmit = chrono::steady_clock::now();
+		}
+
+		Reading *reading = *it;
+		lock_guard<mutex> guard(m_configMutex); // Protect against reconfiguration
+		// Find this asset in the map of values we hold	
+		Reading *out = process(reading, findState(reading->getAssetName()));
+		if (out)
+			(*readings)[forwarded++] = out;
+	}
+	readings->resize(forwarded);
+}
+
+/**
+ * Filter a set of readings, leaving the readings to forward in the set.
+ * The set keeps its own count of the readings it holds, so the readings
+ * are taken out of the set, filtered and appended to it again rather
+ * than being compacted within the vector of the set. The vector used to
+ * hold them is kept between calls, which are made by the single thread
+ * that passes readings along the pipeline.
+ *
+ * @param readingSet	The incoming readings, on return the readings to forward
+ */
+void DeltaFilter::ingest(ReadingSet *readingSet)
+{
+	const vector<Reading *>& readings = readingSet->getAllReadings();
+	m_ingested.assign(readings.begin(), readings.end());
+	readingSet->clear();
+	ingest(&m_ingested);
+	readingSet->append(m_ingested);
+	m_ingested.clear();
+}
+
+/**
+ * Ingest a set of readings in two passes. The first pass groups the
+ * readings by asset, the second evaluates the readings of each asset in
+ * turn, prefetching the state of the next asset while the readings of
+ * the current one are evaluated, so that the state of an asset is
+ * visited once per set rather than once per reading when the assets are
+ * interleaved. The readings forwarded are left in the order they were
+ * received. The containers used to group the readings are kept between
+ * calls, which are made by the single thread that passes readings along
+ * the pipeline.
+ *
+ * @param readings	The incoming readings, on return the readings to forward
+ */
+void DeltaFilter::ingestGrouped(vector<Reading *> *readings)
+{
+	size_t count = readings->size();
+	m_groupNext.assign(count, count);	// The next reading of the same asset
+	m_groupHeads.clear();			// The first reading of each asset
+	m_groupStates.clear();			// The state of each asset, if any
+	uint64_t version;
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		version = m_stateVersion;
+		for (size_t i = 0; i < count; i++)
+		{
+			const string& asset = (*readings)[i]->getAssetName();
+			DeltaData *delta = findState(asset);
+			if (delta)
+			{
+				auto tail = m_groupTails.insert(pair<DeltaData *, size_t>(delta, i));
+				if (!tail.second)
+				{
+					m_groupNext[tail.first->second] = i;
+					tail.first->second = i;
+					continue;
+				}
+			}
+			else
+			{
+				auto tail = m_groupNewTails.find(asset);
+				if (tail != m_groupNewTails.end())
+				{
+					m_groupNext[tail->second] = i;
+					tail->second = i;
+					continue;
+				}
+				m_groupNewTails.insert(pair<string, size_t>(asset, i));
+			}
+			m_groupHeads.push_back(i);
+			m_groupStates.push_back(delta);
+		}
+		m_groupTails.clear();
+		m_groupNewTails.clear();
+	}
+
+	// Each reading is replaced by the reading to forward, if any
+	for (size_t group = 0; group < m_groupHeads.size(); group++)
+	{
+		lock_guard<mutex> guard(m_configMutex); // Protect against reconfiguration
+		if (version == m_stateVersion)
+		{
+			// No state has been removed since the first pass
+			if (m_groupStates[group])
+				m_hot = m_groupStates[group];
+			if (group + 1 < m_groupHeads.size() && m_groupStates[group + 1])
+				__builtin_prefetch(m_groupStates[group + 1]);
+		}
+		for (size_t i = m_groupHeads[group]; i < count; i = m_groupNext[i])
+		{
+			Reading *reading = (*readings)[i];
+			(*readings)[i] = process(reading, findState(reading->getAssetName()));
+		}
+	}
+
+	size_t forwarded = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if ((*readings)[i])
+			(*readings)[forwarded++] = (*readings)[i];
+	}
+	readings->resize(forwarded);
+}
+
+/**
+ * Process a single reading, creating the state of the asset if it has
+ * not been seen before. Called with the configuration mutex held.
+ *
+ * @param reading	The reading to process
+ * @param delta		The state of the asset, NULL if none is held
+ * @return		The reading to forward or NULL if none is to be forwarded.
+ *			The reading passed in is deleted if it is not forwarded.
+ */
+Reading *DeltaFilter::process(Reading *reading, DeltaData *delta)
+{
+    bool sendOrig = false;
+    Reading* readingToSend = nullptr;
+    unsigned int shed = 0;
+
+	if (!delta && m_segment.isAttached())
+	{
+		delta = attachState(reading->getAssetName());
+	}
+	if (!delta)
+	{
+		delta = new (m_pool) DeltaData(reading, m_pool);
+		delta->select(getSelection(delta));
+		m_state.insert(pair<string, DeltaData *>(delta->getAssetName(), delta));
+		m_hot = delta;
+		scheduleHeartbeat(delta);
+		touch(delta);
+		markDirty(delta);
+		m_stateSize += delta->updateSize();
+		evict(delta);
+		if (timerisset(&m_expiry))
+			expire(delta->getLastSeen(), delta);
+		return reading;
+	}
+
+	touch(delta);
+	if (m_heartbeatThread)
+		delta->m_seenTick = heartbeatTick();
+
+	const AssetOverride *over = getOverride(delta);
+
+	AssetConfig config;
+	config.m_expiry = m_expiry;
+	config.m_toleranceMeasure = (over && over->m_hasToleranceMeasure) ? over->m_toleranceMeasure : m_toleranceMeasure;
+	config.m_tolerance = (over && over->m_hasTolerance) ? over->m_tolerance : m_tolerance;
+	config.m_datapointTolerances = (over && !over->m_datapoints.empty()) ? &over->m_datapoints : NULL;
+	config.m_selection = getSelection(delta);
+	config.m_rate = (over && over->m_hasRate) ? over->m_rate : m_rate;
+	config.m_processingMode = (over && over->m_hasProcessingMode) ? over->m_processingMode : m_processingMode;
+	config.m_drift = m_drift;
+	config.m_targetRate = m_targetRate;
+	config.m_maxRate = (over && over->m_hasMaxRate) ? over->m_maxRate : m_maxRate;
+	config.m_coalesce = m_coalesce;
+	bool send = delta->evaluate(reading, config,
+				m_backPressure.getScale(),
+				sendOrig, readingToSend, shed);
+	if (shed)
+		m_backPressure.shed(shed);
+	if (!send && delta->hasPending())
+	{
+		// Send the held back reading once a token is available
+		struct timeval wait;
+		delta->tokenWait(config.m_maxRate, wait);
+		uint64_t ms = wait.tv_sec * 1000 + (wait.tv_usec + 999) / 1000;
+		delta->m_refillTick = heartbeatTick() + (ms + HEARTBEAT_TICK - 1) / HEARTBEAT_TICK;
+		scheduleHeartbeat(delta);
+	}
+	if (timerisset(&m_expiry))
+		expire(delta->getLastSeen(), delta);
+	if (send)
+	{
+		scheduleHeartbeat(delta);
+
+		// The reference values have changed, a suppressed reading only
+		// moves on the times it was seen and these are written with the
+		// next change, datapoints expired since are expired again once
+		// the state is restored
+		markDirty(delta);
+		m_stateSize -= delta->getSize();
+		m_stateSize += delta->updateSize();
+		evict(delta);
+
+		// evaluate's return value indicates whether a reading needs to be sent onwards
+		if(sendOrig)
+		{
+			// The reading is kept in the compacted set, in other
+			// cases it is deleted
+			return reading;
+		}
+		delete reading;
+		return readingToSend; // readingToSend is allocated on heap
+	}
+
+	if (timerisset(&m_expiry))
+	{
+		// Datapoints may have been removed from the reference values
+		m_stateSize -= delta->getSize();
+		m_stateSize += delta->updateSize();
+	}
+	delete reading;
+	return NULL;
+}
+
+/**
+ * Send the first readings of a set that is still being evaluated onwards
+ *
+ * @param readings	The readings being evaluated
+ * @param count		The number of readings at the start of the set to send
+ */
+void DeltaFilter::emit(vector<Reading *> *readings, size_t count)
+{
+	vector<Reading *> chunk(readings->begin(), readings->begin() + count);
+	output(new ReadingSet(&chunk));
+}
+
+/**
+ * Pass a set of readings onwards to the next element in the pipeline.
+ * If output batching is configured the readings are added to the current
+ * batch, which is sent onwards once it holds enough readings or has been
+ * held for the maximum latency. Empty sets are not sent when batching.
+ *
+ * Readings are sent both from the ingest path and the heartbeat thread,
+ * the calls are serialised so the order of the readings is kept.
+ *
+ * @param readings	The readings to send onwards
+ */
+void DeltaFilter::output(ReadingSet *readings)
+{
+	lock_guard<mutex> outputGuard(m_outputMutex);
+	if (!m_batchLimit)
+	{
+		dispatch(readings);
+		return;
+	}
+	if (readings->getAllReadings().empty())
+	{
+		delete readings;
+		return;
+	}
+	if (!m_batch)
+	{
+		m_batch = readings;
+		m_batchDeadline = chrono::steady_clock::now() + m_batchLatency;
+		m_flushCV.notify_one();
+	}
+	else
+	{
+		m_batch->append(readings);
+		delete readings;
+	}
+	if (m_batch->getAllReadings().size() >= m_batchLimit)
+	{
+		ReadingSet *batch = m_batch;
+		m_batch = NULL;
+		dispatch(batch);
+	}
+}
+
+/**
+ * Send a set of readings onwards, via the output queue if one is
+ * configured or immediately if not. Called with the output mutex held.
+ *
+ * @param readings	The readings to send onwards
+ */
+void DeltaFilter::dispatch(ReadingSet *readings)
+{
+	if (m_outputQueue)
+		m_outputQueue->push(readings);
+	else
+		deliver(readings);
+}
+
+/**
+ * The flush thread, sends a batch of readings onwards once it has been
+ * held for the maximum latency without reaching the batch size
+ */
+void DeltaFilter::flushes()
+{
+	unique_lock<mutex> lck(m_outputMutex);
+	while (!m_flushStop)
+	{
+		if (!m_batch)
+		{
+			m_flushCV.wait(lck);
+			continue;
+		}
+		m_flushCV.wait_until(lck, m_batchDeadline);
+		if (m_batch && !m_flushStop && chrono::steady_clock::now() >= m_batchDeadline)
+		{
+			ReadingSet *batch = m_batch;
+			m_batch = NULL;
+			dispatch(batch);
+		}
+	}
+}
+
+/**
+ * Call the next element in the pipeline with a set of readings. The
+ * time taken by the downstream elements is measured in order to detect
+ * back pressure.
+ *
+ * @param readings	The readings to send onwards
+ */
+void DeltaFilter::deliver(ReadingSet *readings)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	m_func(m_data, readings);
+	double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	lock_guard<mutex> guard(m_configMutex);
+	m_backPressure.latency(elapsed);
+}
+
+/**
+ * The output thread, sends the sets of readings in the output queue
+ * onwards in the order they were queued
+ */
+void DeltaFilter::outputs()
+{
+	ReadingSet *readings;
+	while ((readings = m_outputQueue->pop()) != NULL)
+	{
+		deliver(readings);
+	}
+}
+
+/**
+ * Configure the batching of the readings sent onwards and create, resize
+ * or remove the output queue. Any partial batch is sent onwards first and
+ * when the queue is removed or replaced the readings already queued are
+ * sent onwards. Must not be called with the configuration mutex held, as
+ * the output thread takes it.
+ *
+ * @param depth		The depth of the queue, 0 to send readings immediately
+ * @param batch		The number of readings in a batch, 0 to disable batching
+ * @param latency	The maximum time a batch is held before it is sent
+ */
+void DeltaFilter::configureOutput(size_t depth, size_t batch, chrono::milliseconds latency)
+{
+	unique_lock<mutex> lck(m_outputMutex);
+	if (m_batch)
+	{
+		dispatch(m_batch);
+		m_batch = NULL;
+	}
+	m_batchLimit = batch;
+	m_batchLatency = latency;
+	if (batch && !m_flushThread)
+	{
+		m_flushStop = false;
+		m_flushThread = new thread(&DeltaFilter::flushes, this);
+	}
+	else if (!batch && m_flushThread)
+	{
+		// The flush thread needs the output mutex in order to stop
+		m_flushStop = true;
+		m_flushCV.notify_all();
+		lck.unlock();
+		m_flushThread->join();
+		lck.lock();
+		delete m_flushThread;
+		m_flushThread = NULL;
+	}
+
+	if (m_outputQueue && depth && depth <= m_outputQueue->getCapacity()
+			&& depth > m_outputQueue->getCapacity() / 2)
+	{
+		// The capacity is already that of the requested depth
+		return;
+	}
+	if (m_outputQueue)
+	{
+		m_outputQueue->stop();
+		m_outputThread->join();
+		Logger::getLogger()->info("Delta filter output queue reached a depth of %lu of %lu, the filter was blocked by a full queue %lu times for %.1lfms",
+				m_outputQueue->getMaxDepth(), m_outputQueue->getCapacity(),
+				m_outputQueue->getBlocked(), m_outputQueue->getBlockedTime());
+		delete m_outputThread;
+		delete m_outputQueue;
+		m_outputThread = NULL;
+		m_outputQueue = NULL;
+	}
+	if (depth)
+	{
+		m_outputQueue = new OutputQueue(depth);
+		m_outputThread = new thread(&DeltaFilter::outputs, this);
+	}
+}
+
+/**
+ * Log the statistics of the filter once the statistics interval has
+ * passed since they were last logged. Called as each set of readings
+ * arrives, without either mutex held.
+ */
+void DeltaFilter::reportStatistics()
+{
+	unsigned long shed, evictions, expirations;
+	size_t assets;
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		if (!m_statisticsInterval.count())
+			return;
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now < m_statisticsDue)
+			return;
+		m_statisticsDue = now + m_statisticsInterval;
+		shed = m_backPressure.getShed();
+		evictions = m_evictions;
+		expirations = m_expirations;
+		assets = m_state.size();
+	}
+	Logger *logger = Logger::getLogger();
+	logger->info("Delta filter holds the state of %lu assets, %lu datapoint values were shed, %lu assets evicted and %lu idle assets expired",
+			assets, shed, evictions, expirations);
+
+	lock_guard<mutex> outputGuard(m_outputMutex);
+	if (m_outputQueue)
+	{
+		logger->info("Delta filter output queue has reached a depth of %lu of %lu, the filter was blocked by a full queue %lu times for %.1lfms",
+				m_outputQueue->getMaxDepth(), m_outputQueue->getCapacity(),
+				m_outputQueue->getBlocked(), m_outputQueue->getBlockedTime());
+	}
+}
+
+/**
+ * Return the current tick of the heartbeat timing wheel
+ */
+uint64_t
+DeltaFilter::heartbeatTick()
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_epoch).count()
+		/ HEARTBEAT_TICK;
+}
+
+/**
+ * Schedule the heartbeat of an asset for when its minimum rate deadline
+ * passes or, if a reading of the asset is held back by the maximum rate,
+ * for when a token is available to send it. This is called whenever a
+ * reading of the asset is sent or held back, moving the deadline on.
+ * Called with the configuration mutex held.
+ *
+ * @param delta	The data of the asset
+ */
+void
+DeltaFilter::scheduleHeartbeat(DeltaData *delta)
+{
+	const AssetOverride *over = getOverride(delta);
+	const struct timeval& rate = (over && over->m_hasRate) ? over->m_rate : m_rate;
+	uint64_t expiry = UINT64_MAX;
+	if (timerisset(&rate))
+	{
+		uint64_t ms = rate.tv_sec * 1000 + rate.tv_usec / 1000;
+		expiry = heartbeatTick() + (ms + HEARTBEAT_TICK - 1) / HEARTBEAT_TICK;
+	}
+	if (delta->hasPending() && delta->m_refillTick < expiry)
+		expiry = delta->m_refillTick;
+	if (expiry == UINT64_MAX || !m_heartbeatThread)
+	{
+		m_wheel.cancel(delta);
+		return;
+	}
+	m_wheel.schedule(delta, expiry);
+}
+
+/**
+ * The heartbeat thread. On each tick the timing wheel is advanced and
+ * the last sent values of those assets whose minimum rate deadline has
+ * passed without a reading being sent, and which have not reported since
+ * the deadline was last moved on, are sent again. Only the assets
+ * whose deadline has passed are visited, the asset state is not scanned.
+ *
+ * A reading of an asset held back by the maximum rate is sent instead of
+ * a heartbeat, once a token is available, so the newest value is sent even
+ * if the asset stops reporting. The readings held back for assets whose
+ * state has been removed are also sent.
+ */
+void
+DeltaFilter::heartbeats()
+{
+	unique_lock<mutex> lck(m_configMutex);
+	while (!m_shutdown)
+	{
+		m_heartbeatCV.wait_for(lck, chrono::milliseconds(HEARTBEAT_TICK));
+		if (m_shutdown)
+			break;
+
+		vector<TimingWheel::Timer *> expired;
+		uint64_t tick = heartbeatTick();
+		m_wheel.advance(tick, expired);
+		vector<Reading *> readings;
+		readings.swap(m_released);
+		if (expired.empty() && readings.empty())
+			continue;
+
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		for (auto timer : expired)
+		{
+			if (!isEnabled())
+				break;
+			DeltaData *delta = static_cast<DeltaData *>(timer);
+			const AssetOverride *over = getOverride(delta);
+			const struct timeval& rate = (over && over->m_hasRate) ? over->m_rate : m_rate;
+			Reading *reading = NULL;
+			if (delta->hasPending())
+			{
+				// No heartbeat is sent while a reading is held back
+				if (tick >= delta->m_refillTick)
+					reading = delta->flush((over && over->m_hasMaxRate) ? over->m_maxRate : m_maxRate);
+			}
+			else if (timerisset(&rate))
+			{
+				// An asset that is still reporting has its readings sent by
+				// evaluate once the deadline passes, the heartbeat is only
+				// for assets that have stopped reporting
+				uint64_t ms = rate.tv_sec * 1000 + rate.tv_usec / 1000;
+				uint64_t due = delta->m_seenTick + (ms + HEARTBEAT_TICK - 1) / HEARTBEAT_TICK;
+				if (tick <= due)
+				{
+					m_wheel.schedule(delta, due + 1);
+					continue;
+				}
+				reading = delta->heartbeat(now, rate);
+			}
+			scheduleHeartbeat(delta);
+			if (!reading)
+				continue;
+			readings.push_back(reading);
+			markDirty(delta);
+		}
+		if (readings.empty())
+			continue;
+		Logger::getLogger()->debug("Sending %lu readings to maintain the minimum rate or held back by the maximum rate",
+				(unsigned long)readings.size());
+
+		lck.unlock();
+		output(new ReadingSet(&readings));
+		lck.lock();
+	}
+}
+
+/**
+ * Move the state of an asset to the most recently used end of the
+ * least recently used list
+ *
+ * @param delta	The state of the asset
+ */
+void
+DeltaFilter::touch(DeltaData *delta)
+{
+	if (m_lruHead == delta)
+		return;
+
+	// Unlink from the current position, if any
+	if (delta->m_lruPrev)
+		delta->m_lruPrev->m_lruNext = delta->m_lruNext;
+	if (delta->m_lruNext)
+		delta->m_lruNext->m_lruPrev = delta->m_lruPrev;
+	if (m_lruTail == delta)
+		m_lruTail = delta->m_lruPrev;
+
+	delta->m_lruPrev = NULL;
+	delta->m_lruNext = m_lruHead;
+	if (m_lruHead)
+		m_lruHead->m_lruPrev = delta;
+	m_lruHead = delta;
+	if (!m_lruTail)
+		m_lruTail = delta;
+}
+
+/**
+ * Remove the state held for an asset and free it. The asset will
+ * be treated as being seen for the first time if it is seen again.
+ *
+ * @param delta	The state of the asset
+ */
+void
+DeltaFilter::removeState(DeltaData *delta)
+{
+	if (delta->m_lruPrev)
+		delta->m_lruPrev->m_lruNext = delta->m_lruNext;
+	else
+		m_lruHead = delta->m_lruNext;
+	if (delta->m_lruNext)
+		delta->m_lruNext->m_lruPrev = delta->m_lruPrev;
+	else
+		m_lruTail = delta->m_lruPrev;
+
+	// A reading held back by the maximum rate is sent rather than lost
+	Reading *pending = delta->release();
+	if (pending)
+	{
+		m_released.push_back(pending);
+		m_heartbeatCV.notify_one();
+	}
+
+	clearDirty(delta);
+	if (m_hot == delta)
+		m_hot = NULL;
+	m_stateVersion++;
+	m_stateSize -= delta->getSize();
+	m_segment.remove(delta->getAssetName());
+	m_state.erase(delta->getAssetName());
+	delete delta;
+}
+
+/**
+ * Find the state held for an asset. Readings usually arrive in runs of the
+ * same asset, so the state of the last asset found is checked before the
+ * map is searched.
+ *
+ * @param asset	The name of the asset
+ * @return	The state of the asset or NULL if none is held
+ */
+DeltaFilter::DeltaData *
+DeltaFilter::findState(const string& asset)
+{
+	if (m_hot && m_hot->getAssetName() == asset)
+		return m_hot;
+	DeltaMap::iterator it = m_state.find(asset);
+	if (it == m_state.end())
+		return NULL;
+	m_hot = it->second;
+	return m_hot;
+}
+
+/**
+ * Restore the state of an asset held in the state segment. Only the
+ * state of the assets that are seen is read from the segment.
+ *
+ * @param asset	The name of the asset
+ * @return	The state of the asset or NULL if it is not in the segment
+ */
+DeltaFilter::DeltaData *
+DeltaFilter::attachState(const string& asset)
+{
+	const char *data;
+	size_t length;
+	if (!m_segment.lookup(asset, data, length))
+		return NULL;
+
+	StateReader reader(data, length);
+	DeltaData *delta = DeltaData::restore(reader, m_pool);
+	if (!delta || delta->getAssetName().compare(asset))
+	{
+		Logger::getLogger()->warn("The state of asset %s in %s is corrupt and has been discarded",
+				asset.c_str(), m_segment.getPath().c_str());
+		delete delta;
+		m_segment.remove(asset);
+		return NULL;
+	}
+	delta->select(getSelection(delta));
+	m_state.insert(pair<string, DeltaData *>(delta->getAssetName(), delta));
+	scheduleHeartbeat(delta);
+	touch(delta);
+	m_stateSize += delta->updateSize();
+	evict(delta);
+	return delta;
+}
+
+/**
+ * Write the state of the assets that has changed since the last
+ * checkpoint to the state segment. The state of the other assets is
+ * already held in the segment. This is only called when the filter is
+ * reconfigured or shut down, so the segment is compacted in a single
+ * step if it fills.
+ */
+void
+DeltaFilter::storeSegment()
+{
+	while (m_segment.isAttached())
+	{
+		writeDirty(ULONG_MAX);
+		if (!m_dirtyHead || !m_segment.compact())
+			break;
+	}
+	m_segment.sync();
+}
+
+/**
+ * Mark the state of an asset as changed since it was last written to
+ * the state segment. Nothing is recorded if there is no state segment.
+ *
+ * @param delta	The state of the asset
+ */
+void
+DeltaFilter::markDirty(DeltaData *delta)
+{
+	if (delta->m_dirty || !m_segment.isAttached())
+		return;
+	delta->m_dirty = true;
+	delta->m_dirtyPrev = NULL;
+	delta->m_dirtyNext = m_dirtyHead;
+	if (m_dirtyHead)
+		m_dirtyHead->m_dirtyPrev = delta;
+	m_dirtyHead = delta;
+	m_dirtyCount++;
+}
+
+/**
+ * Mark the state of every asset as changed, used when the state segment
+ * is attached or cleared and so holds none of the current state
+ */
+void
+DeltaFilter::markAllDirty()
+{
+	for (DeltaData *delta = m_lruTail; delta; delta = delta->m_lruPrev)
+	{
+		markDirty(delta);
+	}
+}
+
+/**
+ * Remove the state of an asset from the dirty list
+ *
+ * @param delta	The state of the asset
+ */
+void
+DeltaFilter::clearDirty(DeltaData *delta)
+{
+	if (!delta->m_dirty)
+		return;
+	if (delta->m_dirtyPrev)
+		delta->m_dirtyPrev->m_dirtyNext = delta->m_dirtyNext;
+	else
+		m_dirtyHead = delta->m_dirtyNext;
+	if (delta->m_dirtyNext)
+		delta->m_dirtyNext->m_dirtyPrev = delta->m_dirtyPrev;
+	delta->m_dirtyPrev = NULL;
+	delta->m_dirtyNext = NULL;
+	delta->m_dirty = false;
+	m_dirtyCount--;
+}
+
+/**
+ * Return the number of assets whose state has changed since it was last
+ * written to the state segment
+ */
+unsigned long
+DeltaFilter::getDirtyCount()
+{
+	lock_guard<mutex> guard(m_configMutex);
+	return m_dirtyCount;
+}
+
+/**
+ * Write the state of the assets on the dirty list to the state segment.
+ * Called with the configuration mutex held.
+ *
+ * @param max	The maximum number of assets to write
+ * @return	The number of assets written
+ */
+unsigned long
+DeltaFilter::writeDirty(unsigned long max)
+{
+	unsigned long written = 0;
+	while (m_dirtyHead && written < max)
+	{
+		DeltaData *delta = m_dirtyHead;
+		clearDirty(delta);
+		StateWriter writer;
+		delta->save(writer);
+		if (!m_segment.store(delta->getAssetName(), writer.data()))
+		{
+			markDirty(delta);
+			break;
+		}
+		written++;
+	}
+	return written;
+}
+
+/**
+ * The checkpoint thread. At each checkpoint interval the state of the
+ * assets that has changed since the previous checkpoint is written to
+ * the state segment, so that little is lost if the filter does not shut
+ * down cleanly. The assets are written in chunks of CHECKPOINT_CHUNK,
+ * the lock is released between chunks so that ingest is only ever held
+ * up for the time taken to write one chunk. If the state segment fills
+ * the rest of the chunk is left dirty and the segment is compacted
+ * before the checkpoint continues.
+ */
+void
+DeltaFilter::checkpoints()
+{
+	unique_lock<mutex> lck(m_configMutex);
+	while (!m_shutdown)
+	{
+		if (m_checkpointInterval.count())
+			m_checkpointCV.wait_for(lck, m_checkpointInterval);
+		else
+			m_checkpointCV.wait(lck);
+		if (m_shutdown)
+			break;
+		if (!m_segment.isAttached() || !m_checkpointInterval.count())
+			continue;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		unsigned long written = 0, n;
+		do {
+			n = writeDirty(CHECKPOINT_CHUNK);
+			written += n;
+			if (n < CHECKPOINT_CHUNK && m_dirtyHead && m_segment.isAttached())
+			{
+				if (!compactSegment(lck))
+					break;
+				n = CHECKPOINT_CHUNK;
+			}
+			lck.unlock();
+			this_thread::yield();
+			lck.lock();
+		} while (n == CHECKPOINT_CHUNK && !m_shutdown && m_segment.isAttached());
+		if (written && m_segment.isAttached())
+		{
+			m_segment.sync();
+			Logger::getLogger()->debug("Checkpointed the state of %lu assets in %.1lfms",
+					written,
+					chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		}
+	}
+}
+
+/**
+ * Compact the state segment into a new file, which replaces the segment
+ * file once it has been written. The live state is copied COMPACTION_CHUNK
+ * index slots at a time and the new file is written with the lock
+ * released, so that ingest is not held up by the compaction. Called by
+ * the checkpoint thread with the configuration mutex held.
+ *
+ * @param lck	The lock held on the configuration mutex
+ * @return	False if the segment has not been compacted
+ */
+bool
+DeltaFilter::compactSegment(unique_lock<mutex>& lck)
+{
+	StateSegment::Compaction compaction;
+	m_segment.beginCompaction(compaction);
+	while (!m_segment.copyLive(compaction, COMPACTION_CHUNK))
+	{
+		lck.unlock();
+		this_thread::yield();
+		lck.lock();
+		if (m_shutdown)
+			return false;
+	}
+	lck.unlock();
+	bool written = StateSegment::writeCompaction(compaction);
+	lck.lock();
+	return written && m_segment.installCompaction(compaction);
+}
+
+/**
+ * Evict the least recently used assets until the number of assets and
+ * the memory used by their state are within the configured limits
+ *
+ * @param keep	The asset currently being processed, which is never evicted
+ */
+void
+DeltaFilter::evict(DeltaData *keep)
+{
+	while (m_lruTail && m_lruTail != keep
+			&& ((m_maxAssets && m_state.size() > m_maxAssets)
+				|| (m_maxStateSize && m_stateSize > m_maxStateSize)))
+	{
+		if (m_evictions == 0)
+		{
+			Logger::getLogger()->warn("Delta filter state limit of %lu assets or %lu bytes reached, the least recently used assets will be evicted",
+					m_maxAssets, m_maxStateSize);
+		}
+		Logger::getLogger()->debug("Evicting state of asset %s",
+				m_lruTail->getAssetName().c_str());
+		removeState(m_lruTail);
+		m_evictions++;
+	}
+}
+
+/**
+ * Remove the state of assets that have not been seen for longer than the
+ * expiry time. The least recently used assets are checked, up to
+ * EXPIRY_CHECKS for each reading, so the cost of expiry is spread over
+ * the readings rather than scanning all the assets at once.
+ *
+ * @param now	The timestamp of the current reading
+ * @param keep	The asset currently being processed, which is never expired
+ */
+void
+DeltaFilter::expire(const struct timeval& now, DeltaData *keep)
+{
+	for (int i = 0; i < EXPIRY_CHECKS && m_lruTail && m_lruTail != keep; i++)
+	{
+		struct timeval due;
+		timeradd(&m_lruTail->getLastSeen(), &m_expiry, &due);
+		if (!timercmp(&now, &due, >))
+			break;
+		Logger::getLogger()->debug("Asset %s has not been seen recently, removing its state",
+				m_lruTail->getAssetName().c_str());
+		removeState(m_lruTail);
+		m_expirations++;
+	}
+}
+
+/**
+ * Save the state of all the assets in a compact binary form. The assets
+ * are written from the least to the most recently used so that the
+ * order is preserved when they are restored.
+ *
+ * @return	The encoded state
+ */
+string
+DeltaFilter::saveState()
+{
+	lock_guard<mutex> guard(m_configMutex);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	StateWriter writer;
+	writer.putVarint(STATE_MAGIC);
+	writer.putVarint(STATE_VERSION);
+	if (m_segment.isAttached())
+	{
+		// The state is held in the state segment rather than in storage
+		storeSegment();
+		writer.putVarint(0);
+		Logger::getLogger()->info("Stored the state of %lu assets in %s in %.1lfms",
+				m_state.size(), m_segment.getPath().c_str(),
+				chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		return writer.data();
+	}
+	writer.putVarint(m_state.size());
+	for (DeltaData *delta = m_lruTail; delta; delta = delta->m_lruPrev)
+	{
+		delta->save(writer);
+	}
+
+	Logger::getLogger()->info("Saved the state of %lu assets in %lu bytes in %.1lfms",
+			m_state.size(), writer.data().size(),
+			chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	return writer.data();
+}
+
+/**
+ * Restore the state of the assets saved by saveState(). Assets that
+ * have already been seen since the filter started are not replaced.
+ *
+ * @param data	The encoded state
+ * @return	False if the state could not be restored
+ */
+bool
+DeltaFilter::restoreState(const string& data)
+{
+	lock_guard<mutex> guard(m_configMutex);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	Logger *logger = Logger::getLogger();
+
+	StateReader reader(data.data(), data.size());
+	uint64_t magic, version, count;
+	if (!reader.getVarint(magic) || magic != STATE_MAGIC
+			|| !reader.getVarint(version) || version != STATE_VERSION
+			|| !reader.getVarint(count))
+	{
+		logger->error("The stored state of the delta filter is not valid and has been ignored");
+		return false;
+	}
+
+	unsigned long restored = 0;
+	for (uint64_t i = 0; i < count; i++)
+	{
+		DeltaData *delta = DeltaData::restore(reader, m_pool);
+		if (!delta)
+		{
+			logger->error("The stored state of the delta filter is corrupt, only %lu of %lu assets have been restored",
+					restored, (unsigned long)count);
+			return false;
+		}
+		if (m_state.find(delta->getAssetName()) != m_state.end())
+		{
+			delete delta;
+			continue;
+		}
+		delta->select(getSelection(delta));
+		m_state.insert(pair<string, DeltaData *>(delta->getAssetName(), delta));
+		scheduleHeartbeat(delta);
+		touch(delta);
+		markDirty(delta);
+		m_stateSize += delta->updateSize();
+		restored++;
+	}
+	evict(NULL);
+
+	logger->info("Restored the state of %lu assets in %.1lfms", restored,
+			chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	return true;
+}
+
+/**
+ * Constructor for the DataData class. This is a private class within
+ * the filter class and is used to store the data about a particular
+ * asset.
+ *
+ * @param reading	The reading this delta data related to
+ * @param tolerance	The percentage tolerance configured for the filter
+ * @param rate		The required minimum rate, expressed as time between sends
+ */
+DeltaFilter::DeltaData::DeltaData(Reading *reading, SlabPool& pool) :
+	m_override(NULL), m_overrideVersion(UINT64_MAX),
+	m_lruPrev(NULL), m_lruNext(NULL),
+	m_dirtyPrev(NULL), m_dirtyNext(NULL), m_dirty(false), m_refillTick(0), m_seenTick(0),
+	m_lastSent(new Reading(*reading)),
+	m_datapointTimes(DatapointTimesMap::allocator_type(pool)),
+	m_cusum(CumulativeSumMap::allocator_type(pool)),
+	m_controller(NULL), m_tokens(0.0),
+	m_pending(NULL), m_size(0), m_payloadHash(payloadHash(reading, NULL)), m_repeatable(true)
+{
+	gettimeofday(&m_lastSentTime, NULL);
+	timerclear(&m_tokenTime);
+
+	reading->getUserTimestamp(&m_lastSeen);
+	for (const auto &dp : reading->getReadingData())
+	{
+		DatapointTimes& times = m_datapointTimes[dp->getName()];
+		times.m_sent = m_lastSeen;
+		times.m_seen = m_lastSeen;
+	}
+}
+
+/**
+ * Allocate the data for an asset from a slab pool. The pool is recorded
+ * in a granule ahead of the data, which keeps the data aligned, so that
+ * the data may be returned to it when it is deleted.
+ *
+ * @param size	The size of the data
+ * @param pool	The slab pool of the filter
+ * @return	The memory for the data
+ */
+void *
+DeltaFilter::DeltaData::operator new(size_t size, SlabPool& pool)
+{
+	char *ptr = (char *)pool.allocate(size + POOL_GRANULE);
+	*(SlabPool **)ptr = &pool;
+	return ptr + POOL_GRANULE;
+}
+
+/**
+ * Return the data for an asset whose constructor has failed to its pool
+ *
+ * @param ptr	The data
+ * @param pool	The slab pool the data was allocated from
+ */
+void
+DeltaFilter::DeltaData::operator delete(void *ptr, SlabPool& pool)
+{
+	pool.release((char *)ptr - POOL_GRANULE, sizeof(DeltaData) + POOL_GRANULE);
+}
+
+/**
+ * Return the data for an asset to the slab pool it was allocated from
+ *
+ * @param ptr	The data
+ * @param size	The size of the data
+ */
+void
+DeltaFilter::DeltaData::operator delete(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	char *base = (char *)ptr - POOL_GRANULE;
+	(*(SlabPool **)base)->release(base, size + POOL_GRANULE);
+}
+
+/**
+ * Find the tolerance configured for an individual datapoint of the asset.
+ * The list is short and is searched in place.
+ *
+ * @param tolerances	The tolerances of the datapoints of the asset or NULL
+ * @param dpName	The name of the datapoint
+ * @param tolerance	Set to the tolerance of the datapoint if there is one
+ * @return		True if a tolerance is configured for the datapoint
+ */
+bool
+DeltaFilter::DeltaData::datapointTolerance(const DatapointTolerances *tolerances,
+					const std::string& dpName,
+					double& tolerance)
+{
+	if (!tolerances)
+		return false;
+	for (const auto& dp : *tolerances)
+	{
+		if (dp.first == dpName)
+		{
+			tolerance = dp.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Hash the datapoints of a reading, their names, types and values, so
+ * that a reading that repeats the previous reading of an asset can be
+ * recognised cheaply
+ *
+ * @param reading	The reading
+ * @param selection	The datapoints that are compared or NULL if all are
+ * @return		The hash of the datapoints of the reading
+ */
+uint64_t
+DeltaFilter::DeltaData::payloadHash(const Reading *reading,
+				const DatapointSelection *selection)
+{
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto mix = [&hash, prime](const void *data, size_t length) {
+		const unsigned char *p = (const unsigned char *)data;
+		for (size_t i = 0; i < length; i++)
+		{
+			hash ^= p[i];
+			hash *= prime;
+		}
+	};
+	for (const auto &dp : reading->getReadingData())
+	{
+		const string& name = dp->getName();
+		if (selection && !selection->compared(name))
+			continue;
+		mix(name.data(), name.size() + 1);
+		const DatapointValue& value = dp->getData();
+		DatapointValue::dataTagType type = value.getType();
+		mix(&type, sizeof(type));
+		switch (type)
+		{
+			case DatapointValue::T_INTEGER:
+			{
+				long v = value.toInt();
+				mix(&v, sizeof(v));
+				break;
+			}
+			case DatapointValue::T_FLOAT:
+			{
+				double v = value.toDouble();
+				mix(&v, sizeof(v));
+				break;
+			}
+			case DatapointValue::T_STRING:
+			{
+				const string& v = value.toStringValue();
+				mix(v.data(), v.size());
+				break;
+			}
+			default:
+				// Other types are not compared by the filter
+				break;
+		}
+	}
+	return hash;
+}
+
+/**
+ * Move the datapoints that are not compared from the last sent values
+ * of the asset to those kept for heartbeats only, removing the times they
+ * were sent and seen. Datapoints kept for heartbeats that are compared
+ * again become last sent values. Called when the state of an asset is
+ * created or restored and when the filter is reconfigured.
+ *
+ * @param selection	The datapoints that are compared or NULL if all are
+ */
+void
+DeltaFilter::DeltaData::select(const DatapointSelection *selection)
+{
+	vector<Datapoint *> excluded;
+	excluded.swap(m_excluded);
+	for (const auto dp : excluded)
+	{
+		if (selection && !selection->compared(dp->getName()))
+			m_excluded.push_back(dp);
+		else if (m_lastSent->getDatapoint(dp->getName()))
+			delete dp;
+		else
+			m_lastSent->addDatapoint(dp);
+	}
+	if (!selection)
+		return;
+
+	vector<string> removed;
+	for (const auto &dp : m_lastSent->getReadingData())
+	{
+		if (!selection->compared(dp->getName()))
+			removed.push_back(dp->getName());
+	}
+	for (const auto &dpName : removed)
+	{
+		m_excluded.push_back(m_lastSent->removeDatapoint(dpName));
+		m_datapointTimes.erase(dpName);
+		m_cusum.erase(dpName);
+	}
+
+	// A repeat is recognised by the hash of the compared datapoints only
+	m_payloadHash = payloadHash(m_lastSent, selection);
+}
+
+/**
+ * Return whether a datapoint is compared with its last sent value
+ *
+ * @param dpName	The name of the datapoint
+ * @return		True if the datapoint is compared
+ */
+bool
+DeltaFilter::DatapointSelection::compared(const std::string& dpName) const
+{
+	for (const auto &name : m_exclude)
+	{
+		if (name == dpName)
+			return false;
+	}
+	if (m_include.empty())
+		return true;
+	for (const auto &name : m_include)
+	{
+		if (name == dpName)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * The destructor for the delta data. Sim,le clean up the dynamically
+ * allocated data.
+ */
+DeltaFilter::DeltaData::~DeltaData()
+{
+	delete m_lastSent;
+	delete m_controller;
+	delete m_pending;
+	clearExcluded();
+}
+
+/**
+ * Create a copy of the last sent reading, including the datapoints that
+ * are not compared, to be sent again because the minimum rate deadline
+ * has passed. The times the asset was sent are those of its readings, so
+ * they are moved on by the minimum rate rather than set to the current
+ * time, which is used only as the timestamp of the reading.
+ *
+ * @param now	The time of the heartbeat
+ * @param rate	The minimum rate, expressed as time between sends
+ * @return	The reading to send, the caller takes ownership, or NULL
+ *		if a reading of the asset is held back by the maximum rate
+ */
+Reading *
+DeltaFilter::DeltaData::heartbeat(const struct timeval& now, const struct timeval& rate)
+{
+	if (m_pending)
+	{
+		// The held back reading is newer than the last sent values
+		return NULL;
+	}
+	Reading *reading = new Reading(*m_lastSent);
+	for (const auto dp : m_excluded)
+	{
+		reading->addDatapoint(new Datapoint(*dp));
+	}
+	timeradd(&m_lastSentTime, &rate, &m_lastSentTime);
+	reading->setTimestamp(now);
+	reading->setUserTimestamp(m_lastSentTime);
+	for (auto &times : m_datapointTimes)
+	{
+		times.second.m_sent = m_lastSentTime;
+	}
+	return reading;
+}
+
+/**
+ * Send the reading held back by the maximum rate once a token is
+ * available. The token is taken at the time, in the times of the
+ * readings, at which the bucket holds one again.
+ *
+ * @param maxRate	The interval between readings at the maximum rate
+ * @return		The reading to send, the caller takes ownership, or
+ *			NULL if no reading is held back
+ */
+Reading *
+DeltaFilter::DeltaData::flush(const struct timeval& maxRate)
+{
+	if (!m_pending)
+		return NULL;
+	struct timeval wait, due;
+	tokenWait(maxRate, wait);
+	timeradd(&m_tokenTime, &wait, &due);
+	if (!takeToken(due, maxRate))
+		return NULL;
+	if (m_controller)
+		m_controller->sent();
+	m_lastSentTime = due;
+	return release();
+}
+
+/**
+ * Return the reading held back by the maximum rate, if any, without
+ * taking a token. Used when the state of the asset is removed.
+ *
+ * @return	The reading held back, the caller takes ownership, or NULL
+ */
+Reading *
+DeltaFilter::DeltaData::release()
+{
+	Reading *reading = m_pending;
+	m_pending = NULL;
+	return reading;
+}
+
+/**
+ * Write the reference values of the asset, and the times they were sent
+ * and seen, so that they can be restored when the filter is restarted.
+ * Datapoints of types that are not compared by the filter are not saved.
+ *
+ * @param writer	The writer to append the state to
+ */
+void
+DeltaFilter::DeltaData::save(StateWriter& writer)
+{
+	writer.putString(m_lastSent->getAssetName());
+	writer.putTime(m_lastSentTime);
+	writer.putTime(m_lastSeen);
+
+	const vector<Datapoint *>& dps = m_lastSent->getReadingData();
+	unsigned long count = 0;
+	for (const auto &dp : dps)
+	{
+		DatapointValue::dataTagType type = dp->getData().getType();
+		if (type == DatapointValue::T_INTEGER || type == DatapointValue::T_FLOAT
+				|| type == DatapointValue::T_STRING)
+			count++;
+	}
+	writer.putVarint(count);
+
+	for (const auto &dp : dps)
+	{
+		const DatapointValue& value = dp->getData();
+		switch (value.getType())
+		{
+			case DatapointValue::T_INTEGER:
+				writer.putString(dp->getName());
+				writer.putByte(STATE_INTEGER);
+				writer.putSigned(value.toInt());
+				break;
+			case DatapointValue::T_FLOAT:
+				writer.putString(dp->getName());
+				writer.putByte(STATE_FLOAT);
+				writer.putDouble(value.toDouble());
+				break;
+			case DatapointValue::T_STRING:
+				writer.putString(dp->getName());
+				writer.putByte(STATE_STRING);
+				writer.putString(value.toStringValue());
+				break;
+			default:
+				continue;
+		}
+		DatapointTimes times;
+		auto it = m_datapointTimes.find(dp->getName());
+		if (it != m_datapointTimes.end())
+			times = it->second;
+		writer.putTime(times.m_sent);
+		writer.putTime(times.m_seen);
+	}
+}
+
+/**
+ * Create the data for an asset from the state written by save()
+ *
+ * @param reader	The reader positioned at the start of the asset
+ * @param pool		The slab pool from which to allocate the data
+ * @return	The new asset data or NULL if the state could not be read
+ */
+DeltaFilter::DeltaData *
+DeltaFilter::DeltaData::restore(StateReader& reader, SlabPool& pool)
+{
+	string asset;
+	struct timeval sent, seen;
+	uint64_t count;
+	if (!reader.getString(asset) || !reader.getTime(sent)
+			|| !reader.getTime(seen) || !reader.getVarint(count))
+	{
+		return NULL;
+	}
+
+	vector<Datapoint *> dps;
+	DatapointTimesMap times((DatapointTimesMap::allocator_type(pool)));
+	for (uint64_t i = 0; i < count; i++)
+	{
+		string name;
+		uint8_t type;
+		if (!reader.getString(name) || !reader.getByte(type))
+			break;
+
+		Datapoint *dp = NULL;
+		if (type == STATE_INTEGER)
+		{
+			int64_t v;
+			if (reader.getSigned(v))
+			{
+				DatapointValue value((long)v);
+				dp = new Datapoint(name, value);
+			}
+		}
+		else if (type == STATE_FLOAT)
+		{
+			double v;
+			if (reader.getDouble(v))
+			{
+				DatapointValue value(v);
+				dp = new Datapoint(name, value);
+			}
+		}
+		else if (type == STATE_STRING)
+		{
+			string v;
+			if (reader.getString(v))
+			{
+				DatapointValue value(v);
+				dp = new Datapoint(name, value);
+			}
+		}
+		if (!dp)
+			break;
+		dps.push_back(dp);
+
+		DatapointTimes& dpTimes = times[name];
+		if (!reader.getTime(dpTimes.m_sent) || !reader.getTime(dpTimes.m_seen))
+			break;
+	}
+	if (dps.size() != count || reader.failed())
+	{
+		for (auto dp : dps)
+			delete dp;
+		return NULL;
+	}
+
+	Reading reading(asset, dps);
+	DeltaData *delta = new (pool) DeltaData(&reading, pool);
+	delta->m_lastSentTime = sent;
+	delta->m_lastSeen = seen;
+	delta->m_datapointTimes.swap(times);
+	return delta;
+}
+
+/**
+ * Recalculate the approximate memory used by the state of the asset.
+ * This is called when the reference values of the asset change.
+ *
+ * @return	The approximate size in bytes
+ */
+size_t
+DeltaFilter::DeltaData::updateSize()
+{
+	// Allow for the nodes of the asset and per datapoint maps
+	const size_t node = 4 * sizeof(void *);
+
+	m_size = sizeof(DeltaData) + sizeof(Reading) + node
+			+ 2 * m_lastSent->getAssetName().size();
+	for (const auto &dp : m_lastSent->getReadingData())
+	{
+		m_size += sizeof(Datapoint) + sizeof(DatapointValue)
+			+ dp->getName().size() + sizeof(Datapoint *);
+		if (dp->getData().getType() == DatapointValue::T_STRING)
+			m_size += dp->getData().toStringValue().size();
+	}
+	for (const auto &times : m_datapointTimes)
+		m_size += node + sizeof(DatapointTimes) + times.first.size();
+	for (const auto &sum : m_cusum)
+		m_size += node + sizeof(CumulativeSum) + sum.first.size();
+	for (const auto dp : m_excluded)
+	{
+		m_size += sizeof(Datapoint) + sizeof(DatapointValue)
+			+ dp->getName().size() + sizeof(Datapoint *);
+		if (dp->getData().getType() == DatapointValue::T_STRING)
+			m_size += dp->getData().toStringValue().size();
+	}
+	if (m_pending)
+		m_size += sizeof(Reading) + m_pending->getReadingData().size()
+			* (sizeof(Datapoint) + sizeof(DatapointValue));
+	return m_size;
+}
+
+/**
+ * Check if a datapoint has not been sent within the minimum rate. Used in
+ * the ONLY_CHANGED_DATAPOINTS processing mode, where unchanged datapoints
+ * of an asset are not sent even though other datapoints of the asset are.
+ *
+ * @param dpName	The name of the datapoint
+ * @param now		The timestamp of the reading being sent
+ * @param rate		The minimum rate, expressed as time between sends
+ * @return	True if the datapoint should be sent again
+ */
+bool
+DeltaFilter::DeltaData::datapointStale(const string& dpName, const struct timeval& now,
+					const struct timeval& rate)
+{
+	auto it = m_datapointTimes.find(dpName);
+	if (it == m_datapointTimes.end())
+	{
+		return false;
+	}
+	struct timeval due;
+	timeradd(&it->second.m_sent, &rate, &due);
+	return timercmp(&now, &due, >);
+}
+
+/**
+ * Remove the datapoints that have not been seen in the readings of the
+ * asset for longer than the expiry time from the reference values. Only
+ * the datapoints of this asset are visited.
+ *
+ * @param now		The timestamp of the current reading
+ * @param expiry	The time after which unseen datapoints are removed
+ */
+void
+DeltaFilter::DeltaData::expireDatapoints(const struct timeval& now, const struct timeval& expiry)
+{
+	vector<string> expired;
+	for (const auto &dp : m_lastSent->getReadingData())
+	{
+		DatapointTimes& times = m_datapointTimes[dp->getName()];
+		if (!timerisset(&times.m_seen))
+		{
+			// Expiry was enabled after the datapoint was last seen
+			times.m_seen = now;
+			continue;
+		}
+		struct timeval due;
+		timeradd(&times.m_seen, &expiry, &due);
+		if (timercmp(&now, &due, >))
+			expired.push_back(dp->getName());
+	}
+	for (const auto &dpName : expired)
+	{
+		Logger::getLogger()->debug("Datapoint %s of asset %s has not been seen recently, removing it",
+				dpName.c_str(), m_lastSent->getAssetName().c_str());
+		delete m_lastSent->removeDatapoint(dpName);
+		m_datapointTimes.erase(dpName);
+		m_cusum.erase(dpName);
+	}
+}
+
+/**
+ * Take a token from the token bucket that enforces the maximum rate at
+ * which readings of the asset are sent. The bucket is refilled at the
+ * maximum rate and holds up to one second's worth of tokens, or a single
+ * token if the maximum rate is less than one per second.
+ *
+ * As with the minimum rate the times used are those of the readings.
+ *
+ * @param now		The timestamp of the reading to be sent
+ * @param maxRate	The interval between readings at the maximum rate
+ * @return	True if a reading may be sent
+ */
+bool
+DeltaFilter::DeltaData::takeToken(const struct timeval& now, const struct timeval& maxRate)
+{
+	if (maxRate.tv_sec == 0 && maxRate.tv_usec == 0)
+	{
+		return true;
+	}
+
+	double interval = maxRate.tv_sec + ((double)maxRate.tv_usec / 1000000.0);
+	double capacity = std::fmax(1.0, 1.0 / interval);
+	if (!timerisset(&m_tokenTime))
+	{
+		m_tokens = capacity;
+	}
+	else if (timercmp(&now, &m_tokenTime, >))
+	{
+		struct timeval elapsed;
+		timersub(&now, &m_tokenTime, &elapsed);
+		m_tokens += (elapsed.tv_sec + ((double)elapsed.tv_usec / 1000000.0)) / interval;
+		if (m_tokens > capacity)
+			m_tokens = capacity;
+	}
+	if (!timerisset(&m_tokenTime) || timercmp(&now, &m_tokenTime, >))
+	{
+		m_tokenTime = now;
+	}
+
+	// Allow for rounding when the refills sum to a whole token
+	if (m_tokens < 1.0 - 1e-9)
+	{
+		return false;
 	}
+	m_tokens = std::fmax(0.0, m_tokens - 1.0);
+	return true;
 }
 
 /**
- * Filter ingest method, the core of the filter.
- *
- * The ingest method is responsible for takign a set of readings in,
- * applying the rules of the delta file and creating a set of outgoing
- * readings which are the delta's.
+ * Return how long after the last token was taken the token bucket will
+ * hold a token again
  *
- * The incoming readings that are not forwarded will be deleted, if a reading
- * is forwarded then it will put put in the out vector and not freed.
+ * @param maxRate	The interval between readings at the maximum rate
+ * @param wait		Set to the time until a token is available
+ */
+void
+DeltaFilter::DeltaData::tokenWait(const struct timeval& maxRate, struct timeval& wait) const
+{
+	double interval = maxRate.tv_sec + ((double)maxRate.tv_usec / 1000000.0);
+	double needed = (1.0 - m_tokens) * interval;
+	if (!timerisset(&m_tokenTime) || needed <= 0.0)
+	{
+		timerclear(&wait);
+		return;
+	}
+	long usec = (long)ceil(needed * 1000000.0);
+	wait.tv_sec = usec / 1000000;
+	wait.tv_usec = usec % 1000000;
+}
+
+/**
+ * Combine two readings of the asset into one. The datapoints of the newer
+ * reading are kept and any datapoints only present in the older reading are
+ * moved into the newer reading. The older reading is deleted.
  *
- * @param readings	The incoming readings from the previous filter in the pipeline
- * @param out		The outgoing set of readings, these are the delta values
+ * @param older		The older reading, may be NULL
+ * @param newer		The newer reading
+ * @return The combined reading
  */
-void DeltaFilter::ingest(vector<Reading *> *readings, vector<Reading *>& out)
+Reading *
+DeltaFilter::DeltaData::coalesce(Reading *older, Reading *newer)
 {
-    bool sendOrig = false;
-    Reading* readingToSend = nullptr;
-    
-	// Iterate over the readings
-	for (vector<Reading *>::const_iterator it = readings->begin();
-					it != readings->end(); it++)
+	if (older)
 	{
-		Reading *reading = *it;
-		lock_guard<mutex> guard(m_configMutex); // Protect against reconfiguration
-		// Find this asset in the map of values we hold	
-		DeltaMap::iterator deltaIt = m_state.find(reading->getAssetName());
-		if (deltaIt == m_state.end())
-		{
-			DeltaData *delta = new DeltaData(reading);
-			m_state.insert(pair<string, DeltaData *>(delta->getAssetName(), delta));
-			out.push_back(*it);
-		}
-		else if (deltaIt->second->evaluate(reading, m_toleranceMeasure,
-					getTolerance(reading->getAssetName()), m_rate, 
-					m_processingMode, sendOrig, readingToSend))
+		vector<Datapoint *>& datapoints = older->getReadingData();
+		for (auto it = datapoints.begin(); it != datapoints.end(); )
 		{
-			// evaluate's return value indicates whether a reading needs to be sent onwards
-			if(sendOrig)
+			if (newer->getDatapoint((*it)->getName()) == NULL)
 			{
-				// Safe to just use reading as we clear the reading set
-				// at the end. Hence in other cases we delete the reading
-				out.push_back(*it);
+				newer->addDatapoint(*it);
+				it = datapoints.erase(it);
 			}
 			else
 			{
-				if(readingToSend)
-					out.push_back(readingToSend); // readingToSend is allocated on heap
-				delete *it;
+				++it;
 			}
 		}
-		else
-		{
-			delete *it;
-		}
+		delete older;
 	}
-	readings->clear();
+	return newer;
 }
 
 /**
- * Constructor for the DataData class. This is a private class within
- * the filter class and is used to store the data about a particular
- * asset.
+ * Record the value of a datapoint that is not compared as sent, so that
+ * heartbeats of the asset repeat it
  *
- * @param reading	The reading this delta data related to
- * @param tolerance	The percentage tolerance configured for the filter
- * @param rate		The required minimum rate, expressed as time between sends
+ * @param dp	The datapoint sent
  */
-DeltaFilter::DeltaData::DeltaData(Reading *reading) :
-	m_lastSent(new Reading(*reading))
+void
+DeltaFilter::DeltaData::excludedSent(const Datapoint *dp)
 {
-	gettimeofday(&m_lastSentTime, NULL);
+	for (auto &excluded : m_excluded)
+	{
+		if (excluded->getName() == dp->getName())
+		{
+			delete excluded;
+			excluded = new Datapoint(*dp);
+			return;
+		}
+	}
+	m_excluded.push_back(new Datapoint(*dp));
 }
 
 /**
- * The destructor for the delta data. Sim,le clean up the dynamically
- * allocated data.
+ * Remove the values of the datapoints that are not compared
  */
-DeltaFilter::DeltaData::~DeltaData()
+void
+DeltaFilter::DeltaData::clearExcluded()
 {
-	delete m_lastSent;
+	for (const auto dp : m_excluded)
+	{
+		delete dp;
+	}
+	m_excluded.clear();
 }
 
 /**
@@ -191,6 +1922,48 @@ bool checkToleranceExceeded(const string &dpName, const DatapointValue& oValue,
 	return false;
 }
 
+/**
+ * Accumulate the deviation of a new datapoint value from the last sent value
+ * into the positive and negative cumulative sums held for the datapoint and
+ * check whether either of them now exceeds the tolerance.
+ *
+ * The drift is subtracted from the deviation before it is accumulated, this
+ * allows the sums to decay back towards zero when the value returns to the
+ * last sent value, so that isolated noise spikes do not build up over time.
+ *
+ * @param dpName		Datapoint name
+ * @param oValue		Last sent DatapointValue
+ * @param nValue		New DatapointValue
+ * @param toleranceMeasure	Measure of tolerance and drift: percentage or absolute value
+ * @param tolerance		Threshold for the cumulative sums
+ * @param drift			Allowance subtracted from each deviation
+ * @param change		Returns the larger of the two cumulative sums
+ * @return bool			Whether the threshold was exceeded
+ */
+bool
+DeltaFilter::DeltaData::checkCumulativeSumExceeded(const string& dpName,
+		const DatapointValue& oValue, const DatapointValue& nValue,
+		DeltaFilter::ToleranceMeasure toleranceMeasure, double tolerance,
+		double drift, double &change)
+{
+	double prevValue = (oValue.getType() == DatapointValue::T_INTEGER) ? (double)oValue.toInt() : oValue.toDouble();
+	double newValue = (nValue.getType() == DatapointValue::T_INTEGER) ? (double)nValue.toInt() : nValue.toDouble();
+
+	double deviation = newValue - prevValue;
+	if (toleranceMeasure == DeltaFilter::ToleranceMeasure::PERCENTAGE)
+		deviation = (deviation * 100.0) / fabs(prevValue);
+
+	CumulativeSum& sum = m_cusum[dpName];
+	sum.m_high = std::fmax(0.0, sum.m_high + deviation - drift);
+	sum.m_low = std::fmax(0.0, sum.m_low - deviation - drift);
+	change = std::fmax(sum.m_high, sum.m_low);
+
+	Logger::getLogger()->debug("dpName=%s, deviation=%.20lf, cusumHigh=%.20lf, cusumLow=%.20lf, tolerance=%.20lf",
+			dpName.c_str(), deviation, sum.m_high, sum.m_low, tolerance);
+
+	return change > tolerance;
+}
+
 /**
  * Evaluate a reading to determine if it needs to be sent.
  * The conditions that cause it to be sent are:
@@ -201,6 +1974,10 @@ bool checkToleranceExceeded(const string &dpName, const DatapointValue& oValue,
  *  datapoint exceeds the configured tolerance and processing mode 
  *  is suitable w.r.t. the set of changed datapoints.
  *
+ *	3. In the CUMULATIVE_SUM processing mode, the positive or negative
+ *  cumulative sum of the deviations of a datapoint from its last sent
+ *  value exceeds the configured tolerance.
+ *
  * If the reading is sent, a copy of sent datapoints is stored and held
  * in a reading object in the DeltaData class object.
  *
@@ -209,34 +1986,127 @@ bool checkToleranceExceeded(const string &dpName, const DatapointValue& oValue,
  * and not real time. The two may be different because of buffering
  * within the services that make up a Fledge instance.
  *
+ * If a target output rate is set the tolerance passed in is only the
+ * starting point, the tolerance actually used is adjusted over time by a
+ * controller so that the target output rate is not exceeded.
+ *
+ * The tolerance is then multiplied by the scale, which is greater than one
+ * when downstream back pressure has been detected. The datapoints that would
+ * have been sent with the unscaled tolerance but are not sent are reported
+ * as shed.
+ *
+ * If a maximum rate is set, a reading that would be sent is only sent if a
+ * token can be taken from the token bucket of the asset. Otherwise the
+ * reading is suppressed and the last sent values are left unchanged, unless
+ * coalescing is enabled. In that case the last sent values are updated and the
+ * reading is held back, merged with any reading already held back, and sent
+ * as soon as a token becomes available.
+ *
  * @param candidate	        The candidate reading
- * @param toleranceMeasure	Whether tolerance is specified in absolute terms or 
- *                          as a percentage
- * @param tolerance	        Tolerance value in absolute terms or as a percentage 
- *                          (as per toleranceMeasure)
- * @param rate	            Time interval after which a reading must be sent even 
- *                          if tolerance is not exceeded
- * @param processingMode	Output reading processing mode
+ * @param config	        The configuration to apply to the asset, the
+ *                          tolerance measure, tolerance, minimum rate,
+ *                          processing mode, drift, target rate, maximum
+ *                          rate and whether to coalesce suppressed readings
+ * @param scale	            Factor by which to scale the tolerance
  * @param sendOrig	        Whether to send the original reading
  * @param readingToSend	    Reading to send after some DPs have been removed from 
  *                          the original reading
+ * @param shed	            The number of datapoints only suppressed because
+ *                          of the tolerance scale
  * @return                  Whether a reading should be sent out by the filter
  */
 bool
 DeltaFilter::DeltaData::evaluate(Reading *candidate,
-                                    ToleranceMeasure toleranceMeasure,
-                                    double tolerance,
-                                    struct timeval rate,
-                                    DeltaFilter::ProcessingMode processingMode,
+                                    const AssetConfig& config,
+                                    double scale,
                                     bool &sendOrig,
-                                    Reading* &readingToSend)
+                                    Reading* &readingToSend,
+                                    unsigned int &shed)
 {
+ToleranceMeasure toleranceMeasure = config.m_toleranceMeasure;
+double	tolerance = config.m_tolerance;
+struct timeval	rate = config.m_rate;
+ProcessingMode	processingMode = config.m_processingMode;
+double	drift = config.m_drift;
+const struct timeval& targetRate = config.m_targetRate;
 bool    maxPeriodElapsed = false;
 struct timeval	now, res;
+double	largestChange = 0.0;
+unsigned int unscaledChanges = 0;
 Logger *logger = Logger::getLogger();
 
+	shed = 0;
+
 	logger->debug("INPUT READING: '%s' ", candidate->toJSON().c_str());
 
+	// The datapoints that are not compared are only kept for heartbeats
+	if (!timerisset(&rate))
+		clearExcluded();
+
+	candidate->getUserTimestamp(&now);
+	if (timercmp(&now, &m_lastSeen, >))
+		m_lastSeen = now;
+	if (timerisset(&config.m_expiry))
+	{
+		size_t seen = 0;
+		for (const auto &dp : candidate->getReadingData())
+		{
+			if (config.m_selection && !config.m_selection->compared(dp->getName()))
+				continue;
+			m_datapointTimes[dp->getName()].m_seen = now;
+			seen++;
+		}
+
+		// Only look for expired datapoints if some are missing from this reading
+		if (m_lastSent->getReadingData().size() > seen)
+			expireDatapoints(now, config.m_expiry);
+	}
+
+	// A repeat of a reading that would be evaluated to the same result is
+	// dropped without comparing the datapoints
+	uint64_t hash = payloadHash(candidate, config.m_selection);
+	if (m_repeatable && hash == m_payloadHash && !m_pending
+			&& targetRate.tv_sec == 0 && targetRate.tv_usec == 0)
+	{
+		timeradd(&m_lastSentTime, &rate, &res);
+		if ((rate.tv_sec == 0 && rate.tv_usec == 0) || !timercmp(&now, &res, >))
+		{
+			sendOrig = false;
+			readingToSend = nullptr;
+			return false;
+		}
+	}
+	m_payloadHash = hash;
+	m_repeatable = false;
+
+	if (targetRate.tv_sec != 0 || targetRate.tv_usec != 0)
+	{
+		if (m_controller && (m_controller->getInterval().tv_sec != targetRate.tv_sec
+					|| m_controller->getInterval().tv_usec != targetRate.tv_usec))
+		{
+			// The target rate has been reconfigured
+			delete m_controller;
+			m_controller = NULL;
+		}
+		if (!m_controller)
+		{
+			m_controller = new ToleranceController(targetRate);
+		}
+		candidate->getUserTimestamp(&now);
+		tolerance = m_controller->getTolerance(now, tolerance);
+	}
+	else if (m_controller)
+	{
+		delete m_controller;
+		m_controller = NULL;
+	}
+	double unscaledTolerance = tolerance;
+	tolerance *= scale;
+
+	// The tolerances of individual datapoints are adjusted in proportion
+	// to the tolerance of the asset
+	double adjustment = (config.m_tolerance > 0.0) ? unscaledTolerance / config.m_tolerance : 1.0;
+
 	if (rate.tv_sec != 0 || rate.tv_usec != 0)
 	{
 		candidate->getUserTimestamp(&now);
@@ -253,16 +2123,32 @@ Logger *logger = Logger::getLogger();
 	const vector<Datapoint *>& nDataPoints = candidate->getReadingData();
 
 	unordered_set<string> changedDPs;
+	vector<string> unscaledDPs;	// Only exceed the unscaled tolerance
+	const DatapointSelection *selection = config.m_selection;
+	size_t comparedDPs = 0;
 
 	// Iterate the datapoints of NEW reading
 	for (vector<Datapoint *>::const_iterator nIt = nDataPoints.begin();
 						 nIt != nDataPoints.end();
 						 ++nIt)
 	{
+		if (selection && !selection->compared((*nIt)->getName()))
+			continue;
+		comparedDPs++;
+
 	        // Get the reference to a DataPointValue
 		const DatapointValue& nValue = (*nIt)->getData();
 
 		bool dpFound = false;
+		bool unscaledExceeded = false;
+		double dpUnscaled = unscaledTolerance;
+		double dpTolerance = tolerance;
+		if (datapointTolerance(config.m_datapointTolerances, (*nIt)->getName(), dpUnscaled))
+		{
+			dpUnscaled *= adjustment;
+			dpTolerance = dpUnscaled * scale;
+		}
+		size_t changedBefore = changedDPs.size();
 
 		// Iterate the datapoints of last reading sent
 		for (vector<Datapoint *>::const_iterator oIt = oDataPoints.begin();
@@ -280,7 +2166,7 @@ Logger *logger = Logger::getLogger();
 			// Get the reference to DataPointValue
 			const DatapointValue& oValue = (*oIt)->getData();
 
-			double change;
+			double change = 0.0;
 
 			// Same datapoint name: check type
 			if (oValue.getType() != nValue.getType())
@@ -289,7 +2175,9 @@ Logger *logger = Logger::getLogger();
 				if ( (oValue.getType() == DatapointValue::T_INTEGER || oValue.getType() == DatapointValue::T_FLOAT) &&  
 						(nValue.getType() == DatapointValue::T_INTEGER || nValue.getType() == DatapointValue::T_FLOAT) )
 				{
-					bool toleranceExceeded = checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, tolerance, change);
+					bool toleranceExceeded = (processingMode == ProcessingMode::CUMULATIVE_SUM) ?
+						checkCumulativeSumExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, dpTolerance, drift, change) :
+						checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, dpTolerance, change);
 
 					if (toleranceExceeded)
 					{
@@ -312,7 +2200,9 @@ Logger *logger = Logger::getLogger();
 				case DatapointValue::T_INTEGER:
 				case DatapointValue::T_FLOAT:
 					{
-						bool toleranceExceeded = checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, tolerance, change);
+						bool toleranceExceeded = (processingMode == ProcessingMode::CUMULATIVE_SUM) ?
+							checkCumulativeSumExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, dpTolerance, drift, change) :
+							checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, dpTolerance, change);
 						if (toleranceExceeded)
 						{
 							logger->debug("Datapoint %s has %lf %schange",
@@ -325,7 +2215,7 @@ Logger *logger = Logger::getLogger();
 
 				case DatapointValue::T_STRING:
 					{
-						bool toleranceExceeded = checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, tolerance, change);
+						bool toleranceExceeded = checkToleranceExceeded((*nIt)->getName(), oValue, nValue, toleranceMeasure, dpTolerance, change);
 						if (toleranceExceeded)
 						{
 							logger->debug("Datapoint %s of STRING type has changed from '%s' to '%s'", 
@@ -343,6 +2233,22 @@ Logger *logger = Logger::getLogger();
 					break;
 				}
 			}
+			if (change > largestChange)
+				largestChange = change;
+			if (scale > 1.0 && changedDPs.size() == changedBefore)
+			{
+				// Would the datapoint have changed with the unscaled tolerance
+				if (processingMode == ProcessingMode::CUMULATIVE_SUM)
+				{
+					unscaledExceeded = change > dpUnscaled;
+				}
+				else
+				{
+					double unscaledChange;
+					unscaledExceeded = checkToleranceExceeded((*nIt)->getName(), oValue, nValue,
+							toleranceMeasure, dpUnscaled, unscaledChange);
+				}
+			}
 		}
 		if (!dpFound)
 		{
@@ -350,33 +2256,77 @@ Logger *logger = Logger::getLogger();
 					(*nIt)->getName().c_str());
 					changedDPs.emplace((*nIt)->getName());
 		}
+		if (changedDPs.size() > changedBefore || unscaledExceeded)
+			unscaledChanges++;
+		if (unscaledExceeded)
+			unscaledDPs.push_back((*nIt)->getName());
 	}
 
-	logger->debug("processingMode=%d, changedDPs.size()=%d, nDataPoints.size()=%d", 
-                                processingMode, changedDPs.size(), nDataPoints.size());
+	logger->debug("processingMode=%d, changedDPs.size()=%lu, nDataPoints.size()=%lu, comparedDPs=%lu", 
+                                processingMode, (unsigned long)changedDPs.size(),
+				(unsigned long)nDataPoints.size(), (unsigned long)comparedDPs);
 
 	for (const auto & k : changedDPs)
 		logger->debug("changedDPs[i]=%s", k.c_str());
 
+	if (m_controller)
+		m_controller->change(largestChange);
+
 	// Act according to processingMode config. Send current reading if:
 	// 1. Long enough time has elapsed to compulsarily send a reading 
 	// 2. Processing mode is ANY_DATAPOINT_MATCHES and atleast one DP has changed
 	// 3. Processing mode is ALL_DATAPOINTS_MATCH and all DPs have changed
 	// 4. Processing mode is ONLY_CHANGED_DATAPOINTS but all DPs have changed, so original reading can be forwarded as such
-	// Can combine condition 3 & 4 with just "changedDPs.size() == nDataPoints.size()", but retaining for better clarity
-	if ( maxPeriodElapsed ||
+	// 5. Processing mode is CUMULATIVE_SUM and the cumulative change of atleast one DP has exceeded the tolerance
+	// Can combine condition 3 & 4 with just "changedDPs.size() == comparedDPs", but retaining for better clarity.
+	// A reading none of whose datapoints are compared has not changed.
+	bool sendFull = maxPeriodElapsed ||
             (processingMode == ProcessingMode::ANY_DATAPOINT_MATCHES && !changedDPs.empty()) ||
-            (processingMode == ProcessingMode::ALL_DATAPOINTS_MATCH && changedDPs.size() == nDataPoints.size()) ||
-            (processingMode == ProcessingMode::ONLY_CHANGED_DATAPOINTS && changedDPs.size() == nDataPoints.size()))
+            (processingMode == ProcessingMode::ALL_DATAPOINTS_MATCH && comparedDPs > 0 && changedDPs.size() == comparedDPs) ||
+            (processingMode == ProcessingMode::ONLY_CHANGED_DATAPOINTS && comparedDPs > 0 && changedDPs.size() == comparedDPs) ||
+            (processingMode == ProcessingMode::CUMULATIVE_SUM && !changedDPs.empty());
+	bool sendPartial = !sendFull && processingMode == ProcessingMode::ONLY_CHANGED_DATAPOINTS
+			&& !changedDPs.empty();
+
+	// Enforce the maximum rate
+	bool throttled = false;
+	if (sendFull || sendPartial)
+	{
+		candidate->getUserTimestamp(&now);
+		throttled = !takeToken(now, config.m_maxRate);
+		if (throttled && !config.m_coalesce)
+		{
+			logger->debug("Maximum rate reached, suppressing reading of %s",
+					candidate->getAssetName().c_str());
+			sendOrig = false;
+			readingToSend = nullptr;
+			return false;
+		}
+	}
+
+	if (sendFull)
 	{
 		// Send current reading out
 		sendOrig = true;
 		readingToSend = nullptr;
 
+		// The reference values change, so restart the cumulative sums
+		for (auto &sum : m_cusum)
+		{
+			sum.second.m_high = 0.0;
+			sum.second.m_low = 0.0;
+		}
+
 		// Update new values of DPs in m_lastSent
 		for (const auto &dp : candidate->getReadingData())
 		{
 			string dpName = dp->getName();
+			if (selection && !selection->compared(dpName))
+			{
+				if (timerisset(&rate))
+					excludedSent(dp);
+				continue;
+			}
 			if (m_lastSent->getDatapoint(dpName))
 			{
 				Datapoint *oldDp = m_lastSent->removeDatapoint(dpName);
@@ -384,6 +2334,7 @@ Logger *logger = Logger::getLogger();
 					delete oldDp;
 			}
 			m_lastSent->addDatapoint(new Datapoint(*dp));
+			datapointSent(dpName, now);
 			logger->debug("FORWARDING FULL READING: Updated m_lastSent: DP '%s' with value '%s'", 
                                             dpName.c_str(),
 					    m_lastSent->getDatapoint(dpName)->toJSONProperty().c_str());
@@ -394,24 +2345,57 @@ Logger *logger = Logger::getLogger();
 		logger->debug("UPDATED REFERENCE: m_lastSent=%s",
 				m_lastSent->toJSON().c_str());
 
+		if (throttled)
+		{
+			// Hold back a copy of the reading until a token is available
+			logger->debug("Maximum rate reached, holding back reading of %s",
+					candidate->getAssetName().c_str());
+			m_pending = coalesce(m_pending, new Reading(*candidate));
+			sendOrig = false;
+			return false;
+		}
+		if (m_pending)
+		{
+			coalesce(m_pending, candidate);
+			m_pending = NULL;
+		}
+
+		// Readings sent because of the minimum rate do not count against the target rate
+		if (m_controller && !maxPeriodElapsed)
+			m_controller->sent();
+
+		// The reference values are now those of the reading
+		m_repeatable = true;
 		candidate->getUserTimestamp(&m_lastSentTime);
 		return true;
 	}
-	else if (processingMode == ProcessingMode::ONLY_CHANGED_DATAPOINTS
-			&& !changedDPs.empty())
+	else if (sendPartial)
 	{
        		// Need to maintain last sent values of unchanged DPs and new values of changed DPs being sent now
 
 		sendOrig = false;
 		readingToSend = new Reading(*candidate);
 
+		// Unchanged DPs that have not been sent within the minimum rate are
+		// sent along with the changed DPs
+		bool refresh = rate.tv_sec != 0 || rate.tv_usec != 0;
+
 		// remove unchanged DPs from readingToSend and update/add changed DPs in m_lastSent
 		for (const auto &dp : candidate->getReadingData())
 		{
 			string dpName = dp->getName();
-			if (changedDPs.count(dpName) == 0)
+			if (selection && !selection->compared(dpName))
+			{
+				// Sent with the changed DPs but not held in m_lastSent
+				if (timerisset(&rate))
+					excludedSent(dp);
+				continue;
+			}
+			if (changedDPs.count(dpName) == 0 && !(refresh && datapointStale(dpName, now, rate)))
 			{
 				logger->debug("ONLY_CHANGED_DATAPOINTS: removing unchanged DP '%s' ", dpName.c_str());
+				if (find(unscaledDPs.begin(), unscaledDPs.end(), dpName) != unscaledDPs.end())
+					shed++;
 				Datapoint *oldDp = readingToSend->removeDatapoint(dpName);
 				if (oldDp)
 					delete oldDp;
@@ -426,6 +2410,7 @@ Logger *logger = Logger::getLogger();
 						delete oldDp;
 				}
 				m_lastSent->addDatapoint(new Datapoint(*candidate->getDatapoint(dpName)));
+				datapointSent(dpName, now);
 				logger->debug("ONLY_CHANGED_DATAPOINTS: Updated m_lastSent: DP '%s' with value '%s'", 
                                                 dpName.c_str(), m_lastSent->getDatapoint(dpName)->toJSONProperty().c_str());
 			}
@@ -433,12 +2418,55 @@ Logger *logger = Logger::getLogger();
 		logger->debug("SENT READING: readingToSend=%s", readingToSend->toJSON().c_str());
 		logger->debug("UPDATED REFERENCE: m_lastSent=%s", m_lastSent->toJSON().c_str());
 
+		if (throttled)
+		{
+			logger->debug("Maximum rate reached, holding back reading of %s",
+					candidate->getAssetName().c_str());
+			m_pending = coalesce(m_pending, readingToSend);
+			readingToSend = nullptr;
+			return false;
+		}
+		if (m_pending)
+		{
+			readingToSend = coalesce(m_pending, readingToSend);
+			m_pending = NULL;
+		}
+
+		if (m_controller)
+			m_controller->sent();
+
+		// The unchanged datapoints are within the unscaled tolerance
+		m_repeatable = (unscaledChanges == changedDPs.size());
 		candidate->getUserTimestamp(&m_lastSentTime);
 		return true;
 	}
 
 	sendOrig = false;
 	readingToSend = nullptr;
+
+	// No datapoint exceeds the tolerance, however the tolerance is scaled.
+	// The cumulative sums change with every reading.
+	m_repeatable = changedDPs.empty() && unscaledChanges == 0
+			&& processingMode != ProcessingMode::CUMULATIVE_SUM;
+
+	// Would the datapoints have been sent if the tolerance had not been scaled
+	if (processingMode != ProcessingMode::ALL_DATAPOINTS_MATCH || unscaledChanges == comparedDPs)
+		shed = unscaledDPs.size();
+
+	// Send any reading held back by the maximum rate once a token is available
+	if (m_pending)
+	{
+		candidate->getUserTimestamp(&now);
+		if (takeToken(now, config.m_maxRate))
+		{
+			readingToSend = m_pending;
+			m_pending = NULL;
+			if (m_controller)
+				m_controller->sent();
+			candidate->getUserTimestamp(&m_lastSentTime);
+			return true;
+		}
+	}
     
 	return false;
 }
@@ -449,28 +2477,140 @@ Logger *logger = Logger::getLogger();
 void
 DeltaFilter::reconfigure(const string& newConfig)
 {
-	lock_guard<mutex> guard(m_configMutex);
-	setConfig(newConfig);
-        handleConfig(m_config);
+	size_t outputDepth, outputBatch;
+	chrono::milliseconds outputLatency;
+	{
+		lock_guard<mutex> guard(m_configMutex);
+		setConfig(newConfig);
+		handleConfig(m_config);
+
+		// Move the heartbeats of all assets on to the new minimum rate
+		for (auto& state : m_state)
+		{
+			scheduleHeartbeat(state.second);
+			// The tolerance applied to a repeated reading may have changed
+			state.second->resetRepeat();
+			// Datapoints that are no longer compared are removed
+			state.second->select(getSelection(state.second));
+			m_stateSize -= state.second->getSize();
+			m_stateSize += state.second->updateSize();
+		}
+
+		// The limits on the state may have been reduced
+		evict(NULL);
+		outputDepth = m_outputDepth;
+		outputBatch = m_outputBatch;
+		outputLatency = m_outputLatency;
+	}
+	configureOutput(outputDepth, outputBatch, outputLatency);
 }
 
 /**
- * Return the tolarance to use for the given asset name
+ * Return the overrides of the configuration for the given asset name
  *
  * @param asset		The name of the asset
- * @return The tolarance to use
+ * @return The overrides for the asset or NULL if there are none
+ */
+const DeltaFilter::AssetOverride *
+DeltaFilter::findOverride(const std::string& asset)
+{
+	int index = m_overrideMatcher.match(asset);
+	if (index != MATCH_NONE)
+	{
+		return &m_overrides[index];
+	}
+	return NULL;
+}
+
+/**
+ * Return the overrides of the configuration for an asset. The result is
+ * cached in the state of the asset, so that the patterns are only matched
+ * when an asset is first seen or after the filter has been reconfigured.
+ *
+ * @param delta		The state of the asset
+ * @return The overrides for the asset or NULL if there are none
+ */
+const DeltaFilter::AssetOverride *
+DeltaFilter::getOverride(DeltaData *delta)
+{
+	if (delta->m_overrideVersion != m_overrideVersion)
+	{
+		delta->m_override = findOverride(delta->getAssetName());
+		delta->m_overrideVersion = m_overrideVersion;
+	}
+	return delta->m_override;
+}
+
+/**
+ * Return the datapoints of an asset that are compared
+ *
+ * @param delta		The state of the asset
+ * @return The datapoints that are compared or NULL if all of them are
+ */
+const DeltaFilter::DatapointSelection *
+DeltaFilter::getSelection(DeltaData *delta)
+{
+	const AssetOverride *over = getOverride(delta);
+	const DatapointSelection *selection = (over && over->m_hasSelection) ? &over->m_selection : &m_selection;
+	return selection->empty() ? NULL : selection;
+}
+
+/**
+ * Parse a JSON array of datapoint names
+ *
+ * @param value		The JSON array
+ * @param names		The names, empty if the value is invalid
+ * @return		False if the value is not an array of strings
  */
-double
-DeltaFilter::getTolerance(const std::string& asset)
+static bool
+parseNames(const Value& value, vector<string>& names)
 {
-	auto t = m_tolerances.find(asset);
-	if (t != m_tolerances.end())
+	names.clear();
+	if (!value.IsArray())
+		return false;
+	for (auto &v : value.GetArray())
 	{
-		return t->second;
+		if (!v.IsString())
+		{
+			names.clear();
+			return false;
+		}
+		names.push_back(v.GetString());
 	}
-	return m_tolerance;
+	return true;
 }
 
+/**
+ * Convert a rate, expressed as a number of readings per unit of time,
+ * into the time interval between readings
+ *
+ * @param rate		The number of readings per unit of time, 0 for no rate
+ * @param unit		The unit of time, per second, minute, hour or day
+ * @param interval	Returns the time interval between readings
+ */
+static void
+rateToInterval(long rate, const string& unit, struct timeval& interval)
+{
+	long seconds = 1;
+	if (unit.compare("per minute") == 0)
+		seconds = 60;
+	else if (unit.compare("per hour") == 0)
+		seconds = 3600;
+	else if (unit.compare("per day") == 0)
+		seconds = 24 * 60 * 60;
+
+	if (rate <= 0)
+	{
+		interval.tv_sec = 0;
+		interval.tv_usec = 0;
+	}
+	else
+	{
+		long long usec = (seconds * 1000000LL) / rate;
+		interval.tv_sec = usec / 1000000;
+		interval.tv_usec = usec % 1000000;
+	}
+}
 
 /**
  * Handle the configuration of the delta filter
@@ -479,8 +2619,24 @@ DeltaFilter::getTolerance(const std::string& asset)
  *  toleranceMeasure	Whether tolerance is specified as percentage/absolute value
  *	tolerance	The tolerance value/percentage when comparing reading data
  *	processingMode	Reading processing mode
+ *	drift		The allowance subtracted from each deviation in the cumulative sum mode
  *	minRate		The minimum rate at which readings should be sent
  *	rateUnit	The units in which minRate is define (per second, minute, hour or day)
+ *	maxRate		The maximum rate at which readings of an asset may be sent
+ *	maxRateUnit	The units in which maxRate is defined
+ *	coalesce	Whether to send the latest reading suppressed by the maximum rate once allowed
+ *	targetRate	The maximum average rate at which readings of an asset should be sent,
+ *			the tolerance of the asset is adjusted automatically to achieve this
+ *	targetRateUnit	The units in which targetRate is defined
+ *	backpressureLatency	The downstream latency in milliseconds above which tolerances are scaled up
+ *	backpressureFactor	The factor by which tolerances are scaled when there is back pressure
+ *	maxAssets	The maximum number of assets for which state is held
+ *	maxStateSize	The maximum memory in kilobytes used to hold the state of assets
+ *	stateExpiry	The time in seconds after which the state of idle assets and datapoints is removed
+ *	stateFile	A file in which to hold the state of the assets, memory mapped
+ *	includeDatapoints	The names of the only datapoints that are compared
+ *	excludeDatapoints	The names of datapoints that are never compared
+ *	statisticsInterval	The interval in seconds at which the statistics are logged
  *
  * @param config	The configuration category for the filter
  */
@@ -496,6 +2652,12 @@ DeltaFilter::handleConfig(const ConfigCategory& config)
 	m_tolerance = strtod(config.getValue("tolerance").c_str(), NULL);
 	logger->info("handleConfig(): toleranceStr='%s', m_tolerance=%.20lf", 
 			config.getValue("tolerance").c_str(), m_tolerance);
+
+	m_drift = 0.0;
+	if (config.itemExists("drift"))
+	{
+		m_drift = strtod(config.getValue("drift").c_str(), NULL);
+	}
     
 	string processingMode = config.getValue("processingMode");
 	logger->info("handleConfig(): processingMode='%s' = %d", 
@@ -509,40 +2671,281 @@ DeltaFilter::handleConfig(const ConfigCategory& config)
 	}
 
 	int minRate = strtol(config.getValue("minRate").c_str(), NULL, 10);
-	string unit = config.getValue("rateUnit");
-	if (minRate == 0)
+	string rateUnit = config.getValue("rateUnit");
+	rateToInterval(minRate, rateUnit, m_rate);
+	bool heartbeats = timerisset(&m_rate);
+
+	string maxRateUnit = "per second";
+	m_maxRate.tv_sec = 0;
+	m_maxRate.tv_usec = 0;
+	if (config.itemExists("maxRate") && config.itemExists("maxRateUnit"))
 	{
-		m_rate.tv_sec = 0;
-		m_rate.tv_usec = 0;
+		int maxRate = strtol(config.getValue("maxRate").c_str(), NULL, 10);
+		maxRateUnit = config.getValue("maxRateUnit");
+		rateToInterval(maxRate, maxRateUnit, m_maxRate);
 	}
-	else if (unit.compare("per second") == 0)
+	m_coalesce = config.itemExists("coalesce") && config.getValue("coalesce").compare("true") == 0;
+	if (m_coalesce && timerisset(&m_maxRate))
+		heartbeats = true;
+
+	m_targetRate.tv_sec = 0;
+	m_targetRate.tv_usec = 0;
+	if (config.itemExists("targetRate") && config.itemExists("targetRateUnit"))
 	{
-		m_rate.tv_sec = 0;
-		m_rate.tv_usec = 1000000 / minRate;
+		int targetRate = strtol(config.getValue("targetRate").c_str(), NULL, 10);
+		rateToInterval(targetRate, config.getValue("targetRateUnit"), m_targetRate);
 	}
-	else if (unit.compare("per minute") == 0)
+	if ((m_targetRate.tv_sec != 0 || m_targetRate.tv_usec != 0)
+			&& (m_rate.tv_sec != 0 || m_rate.tv_usec != 0)
+			&& timercmp(&m_rate, &m_targetRate, <))
 	{
-		m_rate.tv_sec = 60 / minRate;
-		m_rate.tv_usec = 0;
+		logger->warn("Delta filter: The minimum rate is higher than the target output rate, readings sent to satisfy the minimum rate will exceed the target rate");
 	}
-	else if (unit.compare("per hour") == 0)
+
+	double latency = 0.0, factor = 1.0;
+	if (config.itemExists("backpressureLatency"))
+		latency = strtod(config.getValue("backpressureLatency").c_str(), NULL);
+	if (config.itemExists("backpressureFactor"))
+		factor = strtod(config.getValue("backpressureFactor").c_str(), NULL);
+	m_backPressure.configure(latency, factor);
+
+	chrono::seconds statisticsInterval(0);
+	if (config.itemExists("statisticsInterval"))
+		statisticsInterval = chrono::seconds(strtol(config.getValue("statisticsInterval").c_str(), NULL, 10));
+	if (statisticsInterval.count() < 0)
+		statisticsInterval = chrono::seconds(0);
+	if (statisticsInterval != m_statisticsInterval)
+		m_statisticsDue = chrono::steady_clock::now() + statisticsInterval;
+	m_statisticsInterval = statisticsInterval;
+
+	m_groupByAsset = config.itemExists("groupByAsset")
+			&& config.getValue("groupByAsset").compare("true") == 0;
+
+	m_emitCount = 0;
+	if (config.itemExists("emitCount"))
+		m_emitCount = strtoul(config.getValue("emitCount").c_str(), NULL, 10);
+	m_emitInterval = chrono::milliseconds(0);
+	if (config.itemExists("emitInterval"))
+		m_emitInterval = chrono::milliseconds(strtol(config.getValue("emitInterval").c_str(), NULL, 10));
+
+	// The output queue is created once the configuration mutex is released
+	m_outputDepth = 0;
+	if (config.itemExists("outputQueue"))
+		m_outputDepth = strtoul(config.getValue("outputQueue").c_str(), NULL, 10);
+	m_outputBatch = 0;
+	if (config.itemExists("outputBatch"))
+		m_outputBatch = strtoul(config.getValue("outputBatch").c_str(), NULL, 10);
+	m_outputLatency = chrono::milliseconds(100);
+	if (config.itemExists("outputBatchLatency"))
+		m_outputLatency = chrono::milliseconds(strtol(config.getValue("outputBatchLatency").c_str(), NULL, 10));
+
+	m_maxAssets = 0;
+	if (config.itemExists("maxAssets"))
+		m_maxAssets = strtoul(config.getValue("maxAssets").c_str(), NULL, 10);
+	m_maxStateSize = 0;
+	if (config.itemExists("maxStateSize"))
+		m_maxStateSize = strtoul(config.getValue("maxStateSize").c_str(), NULL, 10) * 1024;
+	timerclear(&m_expiry);
+	if (config.itemExists("stateExpiry"))
+		m_expiry.tv_sec = strtol(config.getValue("stateExpiry").c_str(), NULL, 10);
+
+	// The stored state is discarded if the way it is used changes
+	string stateFile;
+	if (config.itemExists("stateFile"))
+		stateFile = config.getValue("stateFile");
+	uint64_t segmentHash = StateSegment::hash(string("toleranceMeasure=") + config.getValue("toleranceMeasure")
+			+ ";processingMode=" + config.getValue("processingMode"));
+	if (stateFile.compare(m_segment.getPath()))
 	{
-		m_rate.tv_sec = 3600 / minRate;
-		m_rate.tv_usec = 0;
+		if (m_segment.isAttached())
+			storeSegment();
+		m_segment.detach();
+		while (m_dirtyHead)
+			clearDirty(m_dirtyHead);
+		if (!stateFile.empty() && m_segment.attach(stateFile, segmentHash))
+			markAllDirty();
 	}
-	else if (unit.compare("per day") == 0)
+	else if (m_segment.isAttached() && segmentHash != m_segmentHash)
+	{
+		logger->info("The configuration has changed, discarding the stored state in %s",
+				stateFile.c_str());
+		m_segment.clear(segmentHash);
+		markAllDirty();
+	}
+	m_segmentHash = segmentHash;
+
+	m_checkpointInterval = chrono::milliseconds(0);
+	if (config.itemExists("checkpointInterval"))
+		m_checkpointInterval = chrono::milliseconds((long)(strtod(config.getValue("checkpointInterval").c_str(), NULL) * 1000));
+	if (m_checkpointInterval.count() < 0)
+		m_checkpointInterval = chrono::milliseconds(0);
+	if (m_checkpointInterval.count() && !m_checkpointThread)
 	{
-		m_rate.tv_sec = (24 * 60 * 60) / minRate;
-		m_rate.tv_usec = 0;
+		// Write the changed state to the state file in the background
+		m_checkpointThread = new thread(&DeltaFilter::checkpoints, this);
 	}
-	m_tolerances.clear();
+	m_checkpointCV.notify_all();
+
+	m_selection = DatapointSelection();
+	if (config.itemExists("includeDatapoints"))
+	{
+		Document doc;
+		doc.Parse(config.getValue("includeDatapoints").c_str());
+		if (doc.HasParseError() || !parseNames(doc, m_selection.m_include))
+			logger->error("Delta filter: The datapoints to include are not a valid JSON array of names");
+	}
+	if (config.itemExists("excludeDatapoints"))
+	{
+		Document doc;
+		doc.Parse(config.getValue("excludeDatapoints").c_str());
+		if (doc.HasParseError() || !parseNames(doc, m_selection.m_exclude))
+			logger->error("Delta filter: The datapoints to exclude are not a valid JSON array of names");
+	}
+
+	// The states of the assets refer to the overrides and find them again
+	m_overrides.clear();
+	m_overrideMatcher.clear();
+	m_overrideVersion++;
 	if (config.itemExists("overrides"))
 	{
 		Document doc;
 		ParseResult res = doc.Parse(config.getValue("overrides").c_str());
-		for (auto &t : doc.GetObject())
+		if (!res || !doc.IsObject())
 		{
-			m_tolerances.insert(pair<string, double>(t.name.GetString(), t.value.GetDouble()));
+			logger->error("Delta filter: The individual asset overrides are not a valid JSON object");
+		}
+		else
+		{
+			for (auto &t : doc.GetObject())
+			{
+				AssetOverride over;
+				if (t.value.IsNumber())
+				{
+					over.m_hasTolerance = true;
+					over.m_tolerance = t.value.GetDouble();
+				}
+				else if (t.value.IsObject())
+				{
+					for (auto &m : t.value.GetObject())
+					{
+						string key = m.name.GetString();
+						if (key.compare("tolerance") == 0)
+						{
+							if (m.value.IsNumber())
+							{
+								over.m_hasTolerance = true;
+								over.m_tolerance = m.value.GetDouble();
+							}
+						}
+						else if (key.compare("maxRate") == 0)
+						{
+							if (m.value.IsNumber())
+							{
+								string unit = maxRateUnit;
+								if (t.value.HasMember("maxRateUnit") && t.value["maxRateUnit"].IsString())
+									unit = t.value["maxRateUnit"].GetString();
+								over.m_hasMaxRate = true;
+								rateToInterval((long)m.value.GetDouble(), unit, over.m_maxRate);
+								if (m_coalesce && timerisset(&over.m_maxRate))
+									heartbeats = true;
+							}
+						}
+						else if (key.compare("minRate") == 0)
+						{
+							if (m.value.IsNumber())
+							{
+								string unit = rateUnit;
+								if (t.value.HasMember("rateUnit") && t.value["rateUnit"].IsString())
+									unit = t.value["rateUnit"].GetString();
+								over.m_hasRate = true;
+								rateToInterval((long)m.value.GetDouble(), unit, over.m_rate);
+								if (timerisset(&over.m_rate))
+									heartbeats = true;
+							}
+						}
+						else if (key.compare("maxRateUnit") == 0 || key.compare("rateUnit") == 0)
+						{
+							// Used with maxRate and minRate
+						}
+						else if (key.compare("toleranceMeasure") == 0)
+						{
+							if (m.value.IsString())
+							{
+								over.m_hasToleranceMeasure = true;
+								over.m_toleranceMeasure = (string(m.value.GetString()).compare("Percentage") == 0) ?
+									ToleranceMeasure::PERCENTAGE : ToleranceMeasure::ABSOLUTE_VALUE;
+							}
+						}
+						else if (key.compare("processingMode") == 0)
+						{
+							ProcessingMode mode = m.value.IsString() ?
+								parseProcessingMode(m.value.GetString()) : INVALID_MODE;
+							if (mode == INVALID_MODE)
+							{
+								logger->warn("Delta filter: Ignoring invalid processing mode for asset %s",
+										t.name.GetString());
+							}
+							else
+							{
+								over.m_hasProcessingMode = true;
+								over.m_processingMode = mode;
+							}
+						}
+						else if (key.compare("includeDatapoints") == 0)
+						{
+							over.m_hasSelection = true;
+							if (!parseNames(m.value, over.m_selection.m_include))
+								logger->warn("Delta filter: Ignoring invalid datapoints to include for asset %s",
+										t.name.GetString());
+						}
+						else if (key.compare("excludeDatapoints") == 0)
+						{
+							over.m_hasSelection = true;
+							if (!parseNames(m.value, over.m_selection.m_exclude))
+								logger->warn("Delta filter: Ignoring invalid datapoints to exclude for asset %s",
+										t.name.GetString());
+						}
+						else if (key.compare("datapoints") == 0 && m.value.IsObject())
+						{
+							// Datapoints whose names clash with the keys above
+							for (auto &d : m.value.GetObject())
+							{
+								if (d.value.IsNumber())
+									over.m_datapoints.push_back(make_pair(string(d.name.GetString()), d.value.GetDouble()));
+								else
+									logger->warn("Delta filter: Ignoring invalid tolerance for datapoint %s of asset %s",
+											d.name.GetString(), t.name.GetString());
+							}
+						}
+						else if (m.value.IsNumber())
+						{
+							over.m_datapoints.push_back(make_pair(key, m.value.GetDouble()));
+						}
+						else
+						{
+							logger->warn("Delta filter: Ignoring invalid tolerance for datapoint %s of asset %s",
+									key.c_str(), t.name.GetString());
+						}
+					}
+				}
+				else
+				{
+					logger->warn("Delta filter: Ignoring invalid override for asset %s", t.name.GetString());
+					continue;
+				}
+				if (m_overrideMatcher.add(t.name.GetString(), m_overrides.size()))
+					m_overrides.push_back(over);
+				else
+					logger->warn("Delta filter: Ignoring the override %s, it is not a valid regular expression",
+							t.name.GetString());
+			}
 		}
 	}
+
+	if (heartbeats && !m_heartbeatThread)
+	{
+		// Send heartbeats for assets that stop reporting and the
+		// readings held back by the maximum rate
+		m_heartbeatThread = new thread(&DeltaFilter::heartbeats, this);
+	}
 }
@@ -0,0 +1,72 @@
+#ifndef _ASSET_MATCHER_H
+#define _ASSET_MATCHER_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+
+#define MATCH_NONE	(-1)		// Returned by match for an asset no pattern matches
+#define REGEX_PREFIX	"regex:"	// Prefix of a pattern that is a regular expression
+
+/**
+ * Match asset names against a set of patterns, each of which identifies
+ * a value. A pattern may be
+ *
+ *	- an asset name, matched exactly
+ *	- a prefix followed by a single trailing *, e.g. pump*
+ *	- a glob, using *, ? and [...], e.g. site/line?/pump[0-9]
+ *	- a regular expression preceded by regex:, matched against the
+ *	  whole asset name
+ *
+ * The asset names, prefixes and the literal leading parts of the globs
+ * are held in a trie, so that all of them are matched in a single walk
+ * along the asset name. Only the remainder of a glob after its literal
+ * part is matched separately. Regular expressions are compiled once,
+ * when they are added, and tried in the order they were added.
+ *
+ * A prefix or glob also matches the asset whose name is exactly that of
+ * the pattern, so that an asset named tag[1] still matches the pattern
+ * tag[1]. An exact match is preferred, then the prefix or glob with the
+ * longest literal part and lastly a regular expression. A glob is preferred to
+ * a prefix of the same length and amongst globs with the same literal
+ * part the one added first is used.
+ */
+class AssetMatcher {
+	public:
+		AssetMatcher();
+		~AssetMatcher();
+		bool		add(const std::string& pattern, int value);
+		int		match(const std::string& asset) const;
+		void		clear();
+	private:
+		AssetMatcher(const AssetMatcher&);
+		AssetMatcher&	operator=(const AssetMatcher&);
+		/**
+		 * A node of the trie, reached by the characters of the
+		 * asset name that lead to it
+		 */
+		class Node {
+			public:
+				Node() : m_exact(MATCH_NONE), m_prefix(MATCH_NONE) {};
+				~Node();
+				std::map<char, Node *>	m_children;
+				int			m_exact;
+				int			m_prefix;
+				std::vector<std::pair<std::string, int> >
+							m_globs;
+		};
+		Node		*insert(const std::string& literal);
+		static bool	globMatch(const char *glob, const char *name);
+		Node		*m_root;
+		std::vector<std::pair<std::regex, int> >
+				m_regexes;
+};
+
+#endif
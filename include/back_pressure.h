@@ -0,0 +1,50 @@
+#ifndef _BACK_PRESSURE_H
+#define _BACK_PRESSURE_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <chrono>
+
+#define BACKPRESSURE_SMOOTHING	0.25	// Weight of the latest sample in the moving averages
+#define BACKPRESSURE_DECAY	0.5	// Fraction of the excess scale retained per batch on recovery
+
+/**
+ * Detection of back pressure from the downstream elements of the pipeline.
+ *
+ * The time spent passing each batch of readings onwards and the interval
+ * between successive batches arriving are tracked as exponentially weighted
+ * moving averages. When the average time spent downstream exceeds the
+ * configured threshold the tolerances of the filter are scaled up by the
+ * configured factor, causing fewer readings to be sent onwards. Once the
+ * downstream latency falls back below the threshold the scale decays back
+ * towards one with each batch.
+ */
+class BackPressure {
+	public:
+		BackPressure();
+		void		configure(double threshold, double factor);
+		void		arrival();
+		void		latency(double milliseconds);
+		double		getScale() const { return m_scale; };
+		void		shed(unsigned long count) { m_shed += count; m_totalShed += count; };
+		unsigned long	getShed() const { return m_totalShed; };
+		double		getLatency() const { return m_latency; };
+		double		getArrivalRate() const;
+	private:
+		double		m_threshold;
+		double		m_factor;
+		double		m_scale;
+		double		m_latency;
+		double		m_interval;
+		bool		m_first;
+		std::chrono::steady_clock::time_point
+				m_lastArrival;
+		unsigned long	m_shed;
+		unsigned long	m_totalShed;
+};
+
+#endif
@@ -12,11 +12,27 @@
 #include <filter.h>               
 #include <reading_set.h>
 #include <config_category.h>
+#include <tolerance_controller.h>
+#include <back_pressure.h>
+#include <timing_wheel.h>
+#include <state_encoding.h>
+#include <state_segment.h>
+#include <output_queue.h>
+#include <slab_pool.h>
+#include <asset_matcher.h>
 #include <string>                 
 #include <vector>
-#include <regex>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <map>
+#include <unordered_map>
+
+#define HEARTBEAT_TICK	20	// Resolution of the minimum rate timer in milliseconds
+#define EXPIRY_CHECKS	2	// Idle assets checked for expiry per reading
+#define CHECKPOINT_CHUNK	64	// Assets written to the state file each time the lock is taken
+#define COMPACTION_CHUNK	4096	// Index slots copied to compact the state file each time the lock is taken
 
 /**
  * A Fledge filter that is used to filter out duplicate data in the readings stream.
@@ -32,13 +48,36 @@ class DeltaFilter : public FledgeFilter {
                         OUTPUT_HANDLE *outHandle,
                         OUTPUT_STREAM out);
 		~DeltaFilter();
-		void	ingest(std::vector<Reading *> *in, std::vector<Reading *>& out);
+		void	ingest(ReadingSet *readingSet);
+		void	ingest(std::vector<Reading *> *readings);
+		void	output(ReadingSet *readings);
+		void	ingestGrouped(std::vector<Reading *> *readings);
+		void	emit(std::vector<Reading *> *readings, size_t count);
+		void	deliver(ReadingSet *readings);
+		void	dispatch(ReadingSet *readings);
+		void	configureOutput(size_t depth, size_t batch,
+				std::chrono::milliseconds latency);
 		void	reconfigure(const std::string& newConfig);
+		std::string
+			saveState();
+		bool	restoreState(const std::string& data);
+		size_t	getAssetCount() const { return m_state.size(); };
+		size_t	getStateSize() const { return m_stateSize; };
+		unsigned long
+			getShed() const { return m_backPressure.getShed(); };
+		unsigned long
+			getEvictions() const { return m_evictions; };
+		unsigned long
+			getExpirations() const { return m_expirations; };
+		unsigned long
+			getDirtyCount();
+		size_t	getSlabCount() const { return m_pool.getSlabCount(); };
 
 		enum ProcessingMode {
 			ANY_DATAPOINT_MATCHES=1,
 			ALL_DATAPOINTS_MATCH,
 			ONLY_CHANGED_DATAPOINTS,
+			CUMULATIVE_SUM,
 			INVALID_MODE = -1
 		};
 		enum ToleranceMeasure {
@@ -55,39 +94,320 @@ class DeltaFilter : public FledgeFilter {
 				return ProcessingMode::ALL_DATAPOINTS_MATCH;
 			else if(s.compare("Include only the Datapoints that exceed tolerance") == 0)
 				return ProcessingMode::ONLY_CHANGED_DATAPOINTS;
+			else if(s.compare("Include full reading if cumulative change of any Datapoint exceeds tolerance") == 0)
+				return ProcessingMode::CUMULATIVE_SUM;
 			else
 			return ProcessingMode::INVALID_MODE;
 		}
 
 	private:
-		double		getTolerance(const std::string& asset);
-		class DeltaData {
+		/**
+		 * The tolerances of individual datapoints of an asset, held
+		 * as a short list that is searched in place
+		 */
+		typedef std::vector<std::pair<std::string, double> > DatapointTolerances;
+		/**
+		 * The datapoints of an asset that are compared with their
+		 * last sent values. If there is an include list only the
+		 * datapoints in it are compared, those in the exclude list
+		 * are never compared. Datapoints that are not compared are
+		 * not held in the state of the asset but are still sent
+		 * onwards in the readings that are sent. Their last sent
+		 * values are only kept while the asset has a minimum rate,
+		 * so that its heartbeats repeat the whole reading.
+		 */
+		class DatapointSelection {
+			public:
+				bool			empty() const
+							{ return m_include.empty() && m_exclude.empty(); };
+				bool			compared(const std::string& dpName) const;
+				std::vector<std::string>
+							m_include;
+				std::vector<std::string>
+							m_exclude;
+		};
+		/**
+		 * The overrides of the configuration for an individual asset
+		 * or the assets that match a pattern. These are compiled from
+		 * the overrides item when the filter is configured.
+		 */
+		class AssetOverride {
+			public:
+				AssetOverride() : m_hasTolerance(false), m_tolerance(0.0),
+						m_hasMaxRate(false),
+						m_hasToleranceMeasure(false),
+						m_toleranceMeasure(PERCENTAGE),
+						m_hasProcessingMode(false),
+						m_processingMode(ANY_DATAPOINT_MATCHES),
+						m_hasRate(false),
+						m_hasSelection(false)
+						{ timerclear(&m_maxRate); timerclear(&m_rate); };
+				bool			m_hasTolerance;
+				double			m_tolerance;
+				bool			m_hasMaxRate;
+				struct timeval		m_maxRate;
+				bool			m_hasToleranceMeasure;
+				ToleranceMeasure	m_toleranceMeasure;
+				bool			m_hasProcessingMode;
+				ProcessingMode		m_processingMode;
+				bool			m_hasRate;
+				struct timeval		m_rate;
+				bool			m_hasSelection;
+				DatapointSelection	m_selection;
+				DatapointTolerances	m_datapoints;
+		};
+		/**
+		 * The configuration that is applied to the readings of an asset.
+		 * Some of these may be overridden for individual assets or
+		 * individual datapoints.
+		 */
+		class AssetConfig {
+			public:
+				ToleranceMeasure	m_toleranceMeasure;
+				double			m_tolerance;
+				const DatapointTolerances
+							*m_datapointTolerances;
+				const DatapointSelection
+							*m_selection;
+				struct timeval		m_rate;
+				ProcessingMode		m_processingMode;
+				double			m_drift;
+				struct timeval		m_targetRate;
+				struct timeval		m_maxRate;
+				bool			m_coalesce;
+				struct timeval		m_expiry;
+		};
+		/**
+		 * The data held for each asset. The timer is used to send
+		 * the last sent values again when the minimum rate deadline
+		 * of an asset that has stopped reporting passes, or to send
+		 * a reading held back by the maximum rate once the refill
+		 * tick, at which a token is available, is reached. The assets
+		 * are also linked in least recently used order, and those
+		 * whose state has changed since it was last written to the
+		 * state file are linked in a dirty list. Both lists are
+		 * maintained by the filter. The data and the nodes of its maps
+		 * are allocated from the slab pool of the filter, which is
+		 * recorded ahead of the data so that it may be deleted.
+		 */
+		class DeltaData : public TimingWheel::Timer {
 			public:
-				DeltaData(Reading *);
+				DeltaData(Reading *, SlabPool& pool);
 				~DeltaData();
+				static void		*operator new(size_t size, SlabPool& pool);
+				static void		operator delete(void *ptr, SlabPool& pool);
+				static void		operator delete(void *ptr, size_t size);
+				Reading			*heartbeat(const struct timeval& now,
+								const struct timeval& rate);
+				Reading			*flush(const struct timeval& maxRate);
+				Reading			*release();
+				bool			hasPending() const { return m_pending != NULL; };
+				void			tokenWait(const struct timeval& maxRate,
+								struct timeval& wait) const;
+				void			save(StateWriter& writer);
+				static DeltaData	*restore(StateReader& reader, SlabPool& pool);
+				size_t			getSize() const { return m_size; };
+				const struct timeval&	getLastSeen() const { return m_lastSeen; };
+				size_t			updateSize();
+				void			resetRepeat() { m_repeatable = false; };
+				void			select(const DatapointSelection *selection);
+				const AssetOverride	*m_override;
+				uint64_t		m_overrideVersion;
+				DeltaData		*m_lruPrev;
+				DeltaData		*m_lruNext;
+				DeltaData		*m_dirtyPrev;
+				DeltaData		*m_dirtyNext;
+				bool			m_dirty;
+				uint64_t		m_refillTick;
+				uint64_t		m_seenTick;
 				bool			evaluate(Reading *,
-								DeltaFilter::ToleranceMeasure toleranceMeasure,
-								double tolerance,
-								struct timeval rate, 
-								DeltaFilter::ProcessingMode processingMode,
+								const AssetConfig& config,
+								double scale,
 								bool &sendOrig,
-							       	Reading* &readingToSend);
+							       	Reading* &readingToSend,
+								unsigned int &shed);
 				const std::string& 	getAssetName() { return m_lastSent->getAssetName(); };
 			private:
+				/**
+				 * The positive and negative cumulative deviations of
+				 * a datapoint from its last sent value, used by the
+				 * CUMULATIVE_SUM processing mode.
+				 */
+				class CumulativeSum {
+					public:
+						CumulativeSum() : m_high(0.0), m_low(0.0) {};
+						double		m_high;
+						double		m_low;
+				};
+				static bool		datapointTolerance(const DatapointTolerances *tolerances,
+									const std::string& dpName,
+									double& tolerance);
+				bool			checkCumulativeSumExceeded(const std::string& dpName,
+									const DatapointValue& oValue,
+									const DatapointValue& nValue,
+									DeltaFilter::ToleranceMeasure toleranceMeasure,
+									double tolerance,
+									double drift,
+									double &change);
+				/**
+				 * The times at which a datapoint was last sent and
+				 * last seen in a reading of the asset
+				 */
+				class DatapointTimes {
+					public:
+						DatapointTimes() { timerclear(&m_sent); timerclear(&m_seen); };
+						struct timeval	m_sent;
+						struct timeval	m_seen;
+				};
+				void			datapointSent(const std::string& dpName,
+									const struct timeval& when)
+							{ m_datapointTimes[dpName].m_sent = when; };
+				void			expireDatapoints(const struct timeval& now,
+									const struct timeval& expiry);
+				bool			datapointStale(const std::string& dpName,
+									const struct timeval& now,
+									const struct timeval& rate);
+				bool			takeToken(const struct timeval& now,
+									const struct timeval& maxRate);
+				Reading			*coalesce(Reading *older, Reading *newer);
+				void			excludedSent(const Datapoint *dp);
+				void			clearExcluded();
+				static uint64_t		payloadHash(const Reading *reading,
+									const DatapointSelection *selection);
 				Reading			*m_lastSent;
+				std::vector<Datapoint *>
+							m_excluded;
 				struct timeval		m_lastSentTime;
+				struct timeval		m_lastSeen;
+				typedef std::map<std::string, DatapointTimes, std::less<std::string>,
+						PoolAllocator<std::pair<const std::string, DatapointTimes> > >
+							DatapointTimesMap;
+				DatapointTimesMap	m_datapointTimes;
+				typedef std::map<std::string, CumulativeSum, std::less<std::string>,
+						PoolAllocator<std::pair<const std::string, CumulativeSum> > >
+							CumulativeSumMap;
+				CumulativeSumMap	m_cusum;
+				ToleranceController	*m_controller;
+				double			m_tokens;
+				struct timeval		m_tokenTime;
+				Reading			*m_pending;
+				size_t			m_size;
+				uint64_t		m_payloadHash;
+				bool			m_repeatable;
 		};
-		typedef std::map<const std::string, DeltaData *> DeltaMap;
+		typedef std::map<const std::string, DeltaData *, std::less<const std::string>,
+				PoolAllocator<std::pair<const std::string, DeltaData *> > > DeltaMap;
 		void 		handleConfig(const ConfigCategory& conf);
+		uint64_t	heartbeatTick();
+		void		scheduleHeartbeat(DeltaData *delta);
+		void		heartbeats();
+		void		touch(DeltaData *delta);
+		void		removeState(DeltaData *delta);
+		void		evict(DeltaData *keep);
+		void		expire(const struct timeval& now, DeltaData *keep);
+		DeltaData	*findState(const std::string& asset);
+		const AssetOverride
+				*findOverride(const std::string& asset);
+		const AssetOverride
+				*getOverride(DeltaData *delta);
+		const DatapointSelection
+				*getSelection(DeltaData *delta);
+		Reading		*process(Reading *reading, DeltaData *delta);
+		DeltaData	*attachState(const std::string& asset);
+		void		storeSegment();
+		void		markDirty(DeltaData *delta);
+		void		markAllDirty();
+		void		clearDirty(DeltaData *delta);
+		unsigned long	writeDirty(unsigned long max);
+		bool		compactSegment(std::unique_lock<std::mutex>& lck);
+		void		checkpoints();
+		void		outputs();
+		void		flushes();
+		void		reportStatistics();
+		SlabPool	m_pool;
 		DeltaMap	m_state;
+		std::vector<Reading *>
+				m_ingested;
 		struct timeval	m_rate;
+		struct timeval	m_targetRate;
+		struct timeval	m_maxRate;
+		bool		m_coalesce;
 		std::mutex	m_configMutex;
 		double		m_tolerance;
-		std::map<std::string, double>
-				m_tolerances;
+		double		m_drift;
+		std::vector<AssetOverride>
+				m_overrides;
+		AssetMatcher	m_overrideMatcher;
+		DatapointSelection
+				m_selection;
+		uint64_t	m_overrideVersion;
 		ProcessingMode	m_processingMode;
 		ToleranceMeasure
 				m_toleranceMeasure;
+		BackPressure	m_backPressure;
+		unsigned long	m_emitCount;
+		std::chrono::milliseconds
+				m_emitInterval;
+		std::mutex	m_outputMutex;
+		TimingWheel	m_wheel;
+		std::chrono::steady_clock::time_point
+				m_epoch;
+		std::thread	*m_heartbeatThread;
+		std::condition_variable
+				m_heartbeatCV;
+		std::vector<Reading *>
+				m_released;
+		bool		m_shutdown;
+		DeltaData	*m_lruHead;
+		DeltaData	*m_lruTail;
+		unsigned long	m_maxAssets;
+		size_t		m_maxStateSize;
+		size_t		m_stateSize;
+		unsigned long	m_evictions;
+		struct timeval	m_expiry;
+		unsigned long	m_expirations;
+		StateSegment	m_segment;
+		uint64_t	m_segmentHash;
+		DeltaData	*m_dirtyHead;
+		unsigned long	m_dirtyCount;
+		std::chrono::milliseconds
+				m_checkpointInterval;
+		std::thread	*m_checkpointThread;
+		std::condition_variable
+				m_checkpointCV;
+		size_t		m_outputDepth;
+		size_t		m_outputBatch;
+		std::chrono::milliseconds
+				m_outputLatency;
+		OutputQueue	*m_outputQueue;
+		std::thread	*m_outputThread;
+		size_t		m_batchLimit;
+		std::chrono::milliseconds
+				m_batchLatency;
+		ReadingSet	*m_batch;
+		std::chrono::steady_clock::time_point
+				m_batchDeadline;
+		std::thread	*m_flushThread;
+		std::condition_variable
+				m_flushCV;
+		bool		m_flushStop;
+		DeltaData	*m_hot;
+		uint64_t	m_stateVersion;
+		bool		m_groupByAsset;
+		std::vector<size_t>
+				m_groupNext;
+		std::vector<size_t>
+				m_groupHeads;
+		std::vector<DeltaData *>
+				m_groupStates;
+		std::unordered_map<DeltaData *, size_t>
+				m_groupTails;
+		std::unordered_map<std::string, size_t>
+				m_groupNewTails;
+		std::chrono::seconds
+				m_statisticsInterval;
+		std::chrono::steady_clock::time_point
+				m_statisticsDue;
 };
 
 #endif
@@ -0,0 +1,67 @@
+#ifndef _OUTPUT_QUEUE_H
+#define _OUTPUT_QUEUE_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <reading_set.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * A bounded single producer, single consumer queue of the sets of
+ * readings waiting to be sent onwards, used to decouple the evaluation
+ * of the readings from the calls to the next element in the pipeline.
+ *
+ * The queue is a ring buffer whose head and tail are only advanced by
+ * the consumer and the producer respectively, so neither takes a lock
+ * while the queue is neither full nor empty. The mutex is only used to
+ * sleep when the producer finds the queue full or the consumer finds it
+ * empty. Sets are removed in the order they were added.
+ *
+ * The depth of the queue and the time the producer spends blocked on a
+ * full queue are recorded.
+ */
+class OutputQueue {
+	public:
+		OutputQueue(size_t depth);
+		~OutputQueue();
+		void		push(ReadingSet *readings);
+		ReadingSet	*pop();
+		void		stop();
+		size_t		getCapacity() const { return m_ring.size(); };
+		size_t		getDepth() const;
+		size_t		getMaxDepth() const { return m_maxDepth; };
+		unsigned long	getBlocked() const { return m_blocked; };
+		double		getBlockedTime() const { return m_blockedTime; };
+	private:
+		std::vector<ReadingSet *>
+				m_ring;
+		size_t		m_mask;
+		std::atomic<size_t>
+				m_head;
+		std::atomic<size_t>
+				m_tail;
+		std::atomic<bool>
+				m_stopped;
+		std::atomic<bool>
+				m_producerWaiting;
+		std::atomic<bool>
+				m_consumerWaiting;
+		std::mutex	m_mutex;
+		std::condition_variable
+				m_notFull;
+		std::condition_variable
+				m_notEmpty;
+		size_t		m_maxDepth;
+		unsigned long	m_blocked;
+		double		m_blockedTime;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _SLAB_POOL_H
+#define _SLAB_POOL_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <stddef.h>
+#include <vector>
+#include <new>
+
+#define POOL_GRANULE	16			// Size class granularity in bytes
+#define POOL_CLASSES	32			// Number of size classes
+#define POOL_MAX_SIZE	(POOL_GRANULE * POOL_CLASSES)	// Largest object held in the pool
+#define POOL_SLAB_SIZE	(64 * 1024)		// Size of the slabs the objects are carved from
+
+/**
+ * A pool of small, fixed size objects used for the state the filter holds
+ * for each asset. Objects are carved from large slabs and, when freed, are
+ * kept on a free list per size class to be reused by the next object of
+ * that size. The slabs are only released when the pool is destroyed, so a
+ * workload in which assets come and go reuses the same memory rather than
+ * fragmenting the heap. Objects larger than POOL_MAX_SIZE are allocated
+ * from the heap.
+ *
+ * Each instance of the filter owns its own pool and only uses it with its
+ * configuration mutex held, so the pool itself takes no lock and the
+ * instances of the filter in a service do not contend for it.
+ */
+class SlabPool {
+	public:
+		SlabPool();
+		~SlabPool();
+		void			*allocate(size_t size);
+		void			release(void *ptr, size_t size);
+		size_t			getSlabCount() const { return m_slabs.size(); };
+	private:
+		SlabPool(const SlabPool&);
+		SlabPool&		operator=(const SlabPool&);
+		struct FreeObject {
+			FreeObject	*m_next;
+		};
+		FreeObject		*m_free[POOL_CLASSES];
+		std::vector<char *>	m_slabs;
+		char			*m_current;
+		size_t			m_remaining;
+};
+
+/**
+ * An allocator for the standard containers that allocates single elements
+ * from a slab pool, used for the nodes of the maps held per asset. The
+ * containers that use it must be given the pool when they are created.
+ */
+template<class T> class PoolAllocator {
+	public:
+		typedef T	value_type;
+		PoolAllocator(SlabPool& pool) : m_pool(&pool) {};
+		template<class U> PoolAllocator(const PoolAllocator<U>& other) : m_pool(other.m_pool) {};
+		T		*allocate(size_t n)
+				{
+					if (n == 1)
+						return (T *)m_pool->allocate(sizeof(T));
+					return (T *)::operator new(n * sizeof(T));
+				};
+		void		deallocate(T *ptr, size_t n)
+				{
+					if (n == 1)
+						m_pool->release(ptr, sizeof(T));
+					else
+						::operator delete(ptr);
+				};
+		template<class U> bool
+				operator==(const PoolAllocator<U>& other) const { return m_pool == other.m_pool; };
+		template<class U> bool
+				operator!=(const PoolAllocator<U>& other) const { return m_pool != other.m_pool; };
+	private:
+		template<class U> friend class PoolAllocator;
+		SlabPool	*m_pool;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef _STATE_ENCODING_H
+#define _STATE_ENCODING_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <sys/time.h>
+#include <stdint.h>
+#include <string>
+
+#define STATE_MAGIC	0x444c5441	// "DLTA"
+#define STATE_VERSION	1
+
+#define STATE_INTEGER	'i'	// Type codes of the saved datapoint values
+#define STATE_FLOAT	'f'
+#define STATE_STRING	's'
+
+/**
+ * Compact binary encoding of the state of the filter. Integers are
+ * encoded as variable length quantities, seven bits per byte, signed
+ * integers are zig-zag encoded first. Doubles are stored as their
+ * eight byte IEEE representation and strings are prefixed by their
+ * length.
+ */
+class StateWriter {
+	public:
+		void		putVarint(uint64_t value);
+		void		putSigned(int64_t value);
+		void		putDouble(double value);
+		void		putString(const std::string& value);
+		void		putTime(const struct timeval& value);
+		void		putByte(uint8_t value) { m_buffer.push_back((char)value); };
+		const std::string&
+				data() const { return m_buffer; };
+	private:
+		std::string	m_buffer;
+};
+
+/**
+ * Decode the state written by a StateWriter. Any attempt to read
+ * beyond the end of the data, or a malformed value, marks the reader
+ * as failed and returns false.
+ */
+class StateReader {
+	public:
+		StateReader(const char *data, size_t length) :
+				m_ptr(data), m_end(data + length), m_failed(false) {};
+		bool		getVarint(uint64_t& value);
+		bool		getSigned(int64_t& value);
+		bool		getDouble(double& value);
+		bool		getString(std::string& value);
+		bool		getTime(struct timeval& value);
+		bool		getByte(uint8_t& value);
+		bool		atEnd() const { return m_ptr == m_end; };
+		bool		failed() const { return m_failed; };
+		const char	*position() const { return m_ptr; };
+	private:
+		bool		fail() { m_failed = true; return false; };
+		const char	*m_ptr;
+		const char	*m_end;
+		bool		m_failed;
+};
+
+std::string	base64Encode(const std::string& data);
+bool		base64Decode(const std::string& text, std::string& data);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _STATE_SEGMENT_H
+#define _STATE_SEGMENT_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define SEGMENT_MAGIC		0x47455344	// "DSEG"
+#define SEGMENT_VERSION		1
+#define SEGMENT_INITIAL_SLOTS	4096		// Initial number of index slots, a power of 2
+#define SEGMENT_INITIAL_ARENA	(1024 * 1024)	// Initial size of the record arena in bytes
+#define SEGMENT_COMPACT_SUFFIX	".compact"	// Suffix of the file a segment is compacted into
+
+/**
+ * A memory mapped file that holds the state of the assets, so that a
+ * restarted filter can attach to the state and resume without first
+ * reading all of it.
+ *
+ * The file has a header, an open addressing hash index of the asset
+ * names and an arena of records. All references within the file are
+ * offsets from the start of the file, so the layout does not depend on
+ * the address at which the file is mapped. Each record holds the asset
+ * name and the encoded state of the asset, as written by a StateWriter.
+ * Records are only ever appended to the arena, a replaced or removed
+ * record is left as garbage. A record that does not fit is refused and
+ * the segment must be compacted before it is stored.
+ *
+ * A segment is compacted by writing its live records to a new file,
+ * which is renamed over the segment file once it is complete, so a
+ * crash during the compaction leaves the previous file intact. The
+ * compaction is made in steps: the live records are copied a number
+ * of index slots at a time, the new file is written by writeCompaction,
+ * which does not use the segment, and installCompaction then replaces
+ * the segment. A caller that serialises access to the segment with a
+ * lock may release it between the steps. Assets removed meanwhile are
+ * removed from the new file as it is installed, any other change to the
+ * segment abandons the compaction.
+ *
+ * The header carries a version and a hash of the configuration that
+ * the state depends upon, a file that does not match is discarded.
+ */
+class StateSegment {
+	public:
+		/**
+		 * The live records of a segment being compacted and the
+		 * new file they are written to. The new file is removed
+		 * if the compaction is not installed.
+		 */
+		class Compaction {
+			public:
+				Compaction();
+				~Compaction();
+			private:
+				friend class StateSegment;
+				Compaction(const Compaction&);
+				Compaction&	operator=(const Compaction&);
+				uint64_t	m_generation;
+				uint64_t	m_configHash;
+				uint64_t	m_extra;
+				uint64_t	m_slot;
+				uint64_t	m_count;
+				std::string	m_records;
+				std::string	m_path;
+				int		m_fd;
+				char		*m_base;
+				size_t		m_size;
+		};
+		StateSegment();
+		~StateSegment();
+		bool		attach(const std::string& path, uint64_t configHash);
+		void		detach();
+		bool		isAttached() const { return m_base != NULL; };
+		const std::string&
+				getPath() const { return m_path; };
+		bool		lookup(const std::string& asset, const char *&data, size_t& length);
+		bool		store(const std::string& asset, const std::string& record);
+		void		remove(const std::string& asset);
+		void		clear(uint64_t configHash);
+		bool		compact();
+		void		beginCompaction(Compaction& compaction);
+		bool		copyLive(Compaction& compaction, uint64_t slots);
+		static bool	writeCompaction(Compaction& compaction);
+		bool		installCompaction(Compaction& compaction);
+		void		sync();
+		uint64_t	getCount() const;
+		static uint64_t	hash(const std::string& value);
+	private:
+		struct Header {
+			uint32_t	magic;
+			uint32_t	version;
+			uint64_t	configHash;
+			uint64_t	fileSize;
+			uint64_t	slots;
+			uint64_t	count;
+			uint64_t	deleted;
+			uint64_t	arenaStart;
+			uint64_t	arenaUsed;
+			uint64_t	garbage;
+		};
+		struct Slot {
+			uint64_t	hash;
+			uint64_t	offset;
+		};
+		Header		*header() const { return (Header *)m_base; };
+		Slot		*slots() const { return (Slot *)(m_base + sizeof(Header)); };
+		Slot		*find(const std::string& asset, uint64_t hash, bool insert);
+		bool		record(uint64_t offset, const char *&name, uint32_t& nameLength,
+					const char *&data, uint32_t& dataLength) const;
+		bool		map(size_t size);
+		void		initialise(uint64_t configHash, uint64_t slots, uint64_t arena);
+		void		invalidate();
+		bool		valid(uint64_t configHash) const;
+		int		m_fd;
+		char		*m_base;
+		size_t		m_size;
+		std::string	m_path;
+		uint64_t	m_needed;
+		uint64_t	m_generation;
+		bool		m_logRemovals;
+		std::vector<std::string>
+				m_removed;
+};
+
+#endif
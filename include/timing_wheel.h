@@ -0,0 +1,67 @@
+#ifndef _TIMING_WHEEL_H
+#define _TIMING_WHEEL_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define WHEEL_BITS	6			// Number of bits of the tick used per level
+#define WHEEL_SLOTS	(1 << WHEEL_BITS)	// Number of slots in each level
+#define WHEEL_MASK	(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS	4			// Levels, giving a range of 2^24 ticks
+
+/**
+ * A hierarchical timing wheel that holds a large number of timers with
+ * constant time insertion, removal and expiry.
+ *
+ * Time is measured in ticks. Each level of the wheel is an array of slots,
+ * the slots of level 0 are one tick wide, those of level 1 are WHEEL_SLOTS
+ * ticks wide and so on. A timer is placed in the lowest level that covers
+ * its expiry. Each time the lower level wraps around, the timers in the
+ * current slot of the level above are cascaded down into the lower levels.
+ * Timers beyond the range of the wheel are held in the top level and are
+ * placed again as they are cascaded.
+ *
+ * The timers are intrusive, the slots are circular doubly linked lists of
+ * the timers themselves and no memory is allocated by the wheel.
+ */
+class TimingWheel {
+	public:
+		/**
+		 * A timer that may be scheduled in the wheel. Classes that
+		 * need a timer derive from this class. A timer removes itself
+		 * from the wheel when it is destroyed.
+		 */
+		class Timer {
+			public:
+				Timer() : m_next(NULL), m_prev(NULL), m_expiry(0) {};
+				~Timer() { unlink(); };
+				bool		isScheduled() const { return m_next != NULL; };
+				uint64_t	getExpiry() const { return m_expiry; };
+			private:
+				friend class TimingWheel;
+				void		unlink();
+				Timer		*m_next;
+				Timer		*m_prev;
+				uint64_t	m_expiry;
+		};
+		TimingWheel();
+		~TimingWheel();
+		void		schedule(Timer *timer, uint64_t expiry);
+		void		cancel(Timer *timer) { timer->unlink(); };
+		void		advance(uint64_t now, std::vector<Timer *>& expired);
+		uint64_t	getCurrent() const { return m_current; };
+	private:
+		void		place(Timer *timer);
+		void		cascade(unsigned int level, unsigned int slot);
+		uint64_t	m_current;
+		Timer		m_slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+#endif
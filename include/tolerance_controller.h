@@ -0,0 +1,51 @@
+#ifndef _TOLERANCE_CONTROLLER_H
+#define _TOLERANCE_CONTROLLER_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <sys/time.h>
+
+#define BUDGET_BUCKETS		4	// Number of buckets in the sliding window
+#define BUDGET_WINDOW_INTERVALS	10	// Length of the sliding window in target intervals
+
+/**
+ * A feedback controller that adjusts the tolerance used for an asset such
+ * that the rate at which readings are forwarded does not exceed a target
+ * output rate.
+ *
+ * The number of readings forwarded is counted over a sliding window, made up
+ * of a number of buckets, that covers BUDGET_WINDOW_INTERVALS target intervals.
+ * Each time the window slides on by a bucket the observed output rate is
+ * compared with the target and the tolerance is scaled up or down accordingly.
+ * The tolerance is never allowed to drop below the configured tolerance.
+ *
+ * All times are the timestamps of the readings rather than real time, in the
+ * same way as the minimum rate.
+ */
+class ToleranceController {
+	public:
+		ToleranceController(const struct timeval& interval);
+		double		getTolerance(const struct timeval& now, double configured);
+		void		sent() { m_sent[m_bucket]++; };
+		void		change(double change);
+		const struct timeval&
+				getInterval() const { return m_interval; };
+	private:
+		void		adjust(double elapsed, double configured);
+	private:
+		struct timeval	m_interval;
+		double		m_bucketLength;
+		double		m_bucketStart;
+		double		m_start;
+		unsigned int	m_bucket;
+		unsigned long	m_sent[BUDGET_BUCKETS];
+		double		m_changeTotal;
+		unsigned long	m_changeCount;
+		double		m_tolerance;
+};
+
+#endif
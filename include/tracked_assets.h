@@ -0,0 +1,34 @@
+#ifndef _TRACKED_ASSETS_H
+#define _TRACKED_ASSETS_H
+/*
+ * Fledge "Delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <reading.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <mutex>
+
+/**
+ * The assets for which an asset tracking tuple has been added since the
+ * filter was configured, so that the asset tracker is only called the
+ * first time an asset is seen. The assets are cleared when the filter is
+ * reconfigured, in case the tracker has been reset, and are then tracked
+ * again as they are seen.
+ */
+class TrackedAssets {
+	public:
+		void		track(const std::vector<Reading *>& readings,
+					std::vector<std::string>& added);
+		void		clear();
+		size_t		size();
+	private:
+		std::mutex	m_mutex;
+		std::unordered_set<std::string>
+				m_assets;
+};
+#endif
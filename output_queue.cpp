@@ -0,0 +1,127 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <output_queue.h>
+#include <chrono>
+
+using namespace std;
+
+/**
+ * Constructor for the output queue
+ *
+ * @param depth	The number of sets of readings the queue may hold, this
+ *		is rounded up to a power of 2
+ */
+OutputQueue::OutputQueue(size_t depth) : m_head(0), m_tail(0), m_stopped(false),
+	m_producerWaiting(false), m_consumerWaiting(false),
+	m_maxDepth(0), m_blocked(0), m_blockedTime(0.0)
+{
+	size_t capacity = 1;
+	while (capacity < depth)
+		capacity <<= 1;
+	m_ring.resize(capacity, NULL);
+	m_mask = capacity - 1;
+}
+
+/**
+ * Destructor for the output queue, any sets of readings that have not
+ * been sent onwards are freed
+ */
+OutputQueue::~OutputQueue()
+{
+	for (size_t i = m_head; i != m_tail; i++)
+	{
+		delete m_ring[i & m_mask];
+	}
+}
+
+/**
+ * Add a set of readings to the tail of the queue, waiting while the
+ * queue is full. Only one thread may call push at a time.
+ *
+ * @param readings	The set of readings
+ */
+void
+OutputQueue::push(ReadingSet *readings)
+{
+	size_t tail = m_tail.load(memory_order_relaxed);
+	if (tail - m_head.load() == m_ring.size())
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		unique_lock<mutex> lck(m_mutex);
+		m_producerWaiting = true;
+		m_notFull.wait(lck, [this, tail] { return tail - m_head.load() < m_ring.size(); });
+		m_producerWaiting = false;
+		m_blocked++;
+		m_blockedTime += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+	m_ring[tail & m_mask] = readings;
+	m_tail.store(tail + 1);
+
+	size_t depth = tail + 1 - m_head.load();
+	if (depth > m_maxDepth)
+		m_maxDepth = depth;
+
+	if (m_consumerWaiting)
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_notEmpty.notify_one();
+	}
+}
+
+/**
+ * Remove the set of readings at the head of the queue, waiting while
+ * the queue is empty. Only one thread may call pop.
+ *
+ * @return	The set of readings or NULL if the queue has been stopped
+ *		and is empty
+ */
+ReadingSet *
+OutputQueue::pop()
+{
+	size_t head = m_head.load(memory_order_relaxed);
+	if (head == m_tail.load())
+	{
+		unique_lock<mutex> lck(m_mutex);
+		m_consumerWaiting = true;
+		m_notEmpty.wait(lck, [this, head] { return head != m_tail.load() || m_stopped; });
+		m_consumerWaiting = false;
+		if (head == m_tail.load())
+			return NULL;
+	}
+	ReadingSet *readings = m_ring[head & m_mask];
+	m_ring[head & m_mask] = NULL;
+	m_head.store(head + 1);
+
+	if (m_producerWaiting)
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_notFull.notify_one();
+	}
+	return readings;
+}
+
+/**
+ * Stop the queue. The consumer is woken and pop returns NULL once the
+ * sets of readings already in the queue have been removed.
+ */
+void
+OutputQueue::stop()
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_stopped = true;
+	m_notEmpty.notify_all();
+}
+
+/**
+ * Return the number of sets of readings currently in the queue
+ */
+size_t
+OutputQueue::getDepth() const
+{
+	return m_tail.load() - m_head.load();
+}
@@ -19,8 +19,10 @@
 #include <filter.h>
 #include <reading_set.h>
 #include <map>
+#include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <delta_filter.h>
+#include <tracked_assets.h>
 #include <version.h>
 
 #define FILTER_NAME "delta"
@@ -59,18 +61,28 @@ static const char *default_config = QUOTE({
 			"description": "Reading processing mode",
 			"type": "enumeration",
 			"options" : [ "Include full reading if any Datapoint exceeds tolerance", "Include full reading if all Datapoints exceed tolerance", 
-                            "Include only the Datapoints that exceed tolerance" ],
+                            "Include only the Datapoints that exceed tolerance",
+                            "Include full reading if cumulative change of any Datapoint exceeds tolerance" ],
 			"default": "Include full reading if any Datapoint exceeds tolerance",
 			"order" : "3",
 			"displayName" : "Reading Processing Mode"
 			},
+		"drift": {
+			"description": "The allowance subtracted from each change before it is added to the cumulative change of a Datapoint, in the same units as the tolerance",
+			"type": "float",
+			"minimum": "0.0",
+			"default": "0.0",
+			"order" : "4",
+			"displayName" : "Cumulative Drift Allowance",
+			"validity" : "processingMode == \"Include full reading if cumulative change of any Datapoint exceeds tolerance\""
+			},
 		"minRate": {
 			"description": "The minimum rate at which data must be sent",
 			"type": "integer",
 			"minimum": "0",
 			"default": "0",
 			"mandatory": "true",
-			"order" : "4",
+			"order" : "5",
 			"displayName" : "Minimum Rate"
 			},
 		"rateUnit": {
@@ -78,15 +90,184 @@ static const char *default_config = QUOTE({
 			"type": "enumeration",
 			"options" : [ "per second", "per minute", "per hour", "per day" ],
 			"default": "per second",
-			"order" : "5",
+			"order" : "6",
 			"displayName" : "Minimum Rate Units"
 			},
+		"maxRate": {
+			"description": "The maximum rate at which readings of each asset may be sent, regardless of the changes in value. A value of 0 means there is no maximum rate",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "8",
+			"displayName" : "Maximum Rate"
+			},
+		"maxRateUnit": {
+			"description": "The unit used to evaluate the maximum rate",
+			"type": "enumeration",
+			"options" : [ "per second", "per minute", "per hour", "per day" ],
+			"default": "per second",
+			"order" : "9",
+			"displayName" : "Maximum Rate Units",
+			"validity" : "maxRate != \"0\""
+			},
+		"coalesce": {
+			"description": "If a reading is suppressed because of the maximum rate, send the latest suppressed values once the maximum rate allows",
+			"type": "boolean",
+			"default": "false",
+			"order" : "10",
+			"displayName" : "Send Latest Suppressed Values",
+			"validity" : "maxRate != \"0\""
+			},
+		"targetRate": {
+			"description": "The maximum average rate at which readings of each asset should be sent. If set, the tolerance of each asset is increased automatically above the configured tolerance to meet this rate. A value of 0 disables the automatic adjustment of tolerances",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "11",
+			"displayName" : "Target Output Rate"
+			},
+		"targetRateUnit": {
+			"description": "The unit used to evaluate the target output rate",
+			"type": "enumeration",
+			"options" : [ "per second", "per minute", "per hour", "per day" ],
+			"default": "per minute",
+			"order" : "12",
+			"displayName" : "Target Output Rate Units",
+			"validity" : "targetRate != \"0\""
+			},
+		"backpressureLatency": {
+			"description": "The average time in milliseconds taken by the downstream filters and services to accept readings, above which tolerances are temporarily scaled up to reduce the number of readings sent. A value of 0 disables this",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "13",
+			"displayName" : "Downstream Latency Threshold"
+			},
+		"backpressureFactor": {
+			"description": "The factor by which tolerances are scaled when the downstream latency exceeds the threshold",
+			"type": "float",
+			"minimum": "1.0",
+			"default": "2.0",
+			"order" : "14",
+			"displayName" : "Back Pressure Tolerance Factor",
+			"validity" : "backpressureLatency != \"0\""
+			},
+		"groupByAsset": {
+			"description": "Group the readings in each set by asset before they are processed, so that the state of each asset is visited once per set. This benefits sets that interleave the readings of many assets. The readings forwarded are kept in their original order",
+			"type": "boolean",
+			"default": "false",
+			"order" : "15",
+			"displayName" : "Group Readings By Asset"
+			},
+		"emitCount": {
+			"description": "The number of forwarded readings after which they are sent onwards while the rest of a large set of readings is still being processed. A value of 0 means readings are only sent once the whole set has been processed",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "16",
+			"displayName" : "Early Emit Readings"
+			},
+		"emitInterval": {
+			"description": "The time in milliseconds after which the readings forwarded so far are sent onwards while the rest of a large set of readings is still being processed. A value of 0 means readings are only sent once the whole set has been processed",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "17",
+			"displayName" : "Early Emit Interval (ms)"
+			},
+		"outputQueue": {
+			"description": "The number of sets of readings that may be queued to be sent onwards by a separate thread, allowing the filter to process further readings while the next filter or service is busy. A value of 0 means readings are sent onwards immediately",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "18",
+			"displayName" : "Output Queue Depth"
+			},
+		"outputBatch": {
+			"description": "The number of readings to collect, across calls to the filter, before they are sent onwards, so that fewer and larger sets of readings are sent. A value of 0 means readings are sent onwards as each set is processed",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "19",
+			"displayName" : "Output Batch Size"
+			},
+		"outputBatchLatency": {
+			"description": "The maximum time in milliseconds for which readings are held while collecting a batch",
+			"type": "integer",
+			"minimum": "1",
+			"default": "100",
+			"order" : "20",
+			"displayName" : "Output Batch Latency (ms)",
+			"validity" : "outputBatch != \"0\""
+			},
+		"maxAssets": {
+			"description": "The maximum number of assets for which the filter holds state. When exceeded the state of the least recently seen assets is discarded and those assets are treated as new when next seen. A value of 0 means there is no limit",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "21",
+			"displayName" : "Maximum Tracked Assets"
+			},
+		"maxStateSize": {
+			"description": "The maximum memory, in kilobytes, that the filter uses to hold the state of assets. When exceeded the state of the least recently seen assets is discarded. A value of 0 means there is no limit",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "22",
+			"displayName" : "Maximum State Memory (KB)"
+			},
+		"stateExpiry": {
+			"description": "The time in seconds, measured using the reading timestamps, after which the state held for an asset that has not been seen is removed. Datapoints that have not been seen in the readings of an asset for this time are also removed from the values the readings are compared with. A value of 0 means state is never removed",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "23",
+			"displayName" : "State Expiry (seconds)"
+			},
+		"stateFile": {
+			"description": "The path of a file, for example under /dev/shm, in which the state of the assets is held memory mapped. A restarted filter attaches to the file and reads the state of each asset only when it is next seen. If empty the state is saved to storage when the filter shuts down",
+			"type": "string",
+			"default": "",
+			"order" : "24",
+			"displayName" : "State File"
+			},
+		"checkpointInterval": {
+			"description": "The interval in seconds at which the state of the assets that has changed is written to the state file in the background, limiting what is lost if the filter does not shut down cleanly. A value of 0 means the state is only written when the filter shuts down",
+			"type": "float",
+			"minimum": "0",
+			"default": "0",
+			"order" : "25",
+			"displayName" : "Checkpoint Interval (seconds)",
+			"validity" : "stateFile != \"\""
+			},
 		"overrides" : {
-			"description": "Individual asset tolerances, if different from the global tolerance",
+			"description": "Individual asset tolerances, if different from the global tolerance. The asset may be given as a name, a prefix ending in *, a glob or a regular expression preceded by regex:. An asset may also be given an object with a tolerance, toleranceMeasure, processingMode, minRate, rateUnit, maxRate, maxRateUnit, includeDatapoints and excludeDatapoints and the tolerances of individual datapoints",
 			"type": "JSON",
 			"default": "{ }",
-			"order" : "6",
+			"order" : "26",
 			"displayName" : "Individual Tolerances"
+			},
+		"includeDatapoints" : {
+			"description": "The names of the datapoints that are compared with their last sent values. If empty all datapoints are compared. Other datapoints are still sent in the readings that are sent",
+			"type": "JSON",
+			"default": "[ ]",
+			"order" : "27",
+			"displayName" : "Include Datapoints"
+			},
+		"excludeDatapoints" : {
+			"description": "The names of datapoints, such as counters or quality codes, that are never compared with their last sent values but are still sent in the readings that are sent",
+			"type": "JSON",
+			"default": "[ ]",
+			"order" : "28",
+			"displayName" : "Exclude Datapoints"
+			},
+		"statisticsInterval": {
+			"description": "The interval in seconds at which the number of assets held, the number of datapoint values shed by back pressure, the numbers of assets evicted and expired and the use of the output queue are logged. A value of 0 means they are only logged when the filter shuts down",
+			"type": "integer",
+			"minimum": "0",
+			"default": "0",
+			"order" : "29",
+			"displayName" : "Statistics Interval (seconds)"
 			}
 	});
 
@@ -104,16 +285,22 @@ extern "C" {
 static PLUGIN_INFORMATION info = {
         FILTER_NAME,              // Name
         VERSION,                  // Version
-        0,          		  // Flags
+        SP_PERSIST_DATA,          // Flags
         PLUGIN_TYPE_FILTER,       // Type
         "1.0.0",                  // Interface version
 	default_config	          // Default plugin configuration
 };
 
+/**
+ * The plugin handle. The assets for which an asset tracking tuple has
+ * already been added are recorded so that the asset tracker is only
+ * called the first time an asset is seen.
+ */
 typedef struct
 {
 	DeltaFilter	*handle;
 	std::string	configCatName;
+	TrackedAssets	tracked;
 } FILTER_INFO;
 
 /**
@@ -167,53 +354,46 @@ void plugin_ingest(PLUGIN_HANDLE *handle,
 	DeltaFilter *filter = info->handle;
 	if (!filter->isEnabled())
 	{
-		// Current filter is not active: just pass the readings set
-		filter->m_func(filter->m_data, readingSet);
+		// Current filter is not active: just pass the readings set,
+		// behind any readings that are already queued
+		filter->output(readingSet);
 		return;
 	}
 
-	vector<Reading *> newReadings;
-	filter->ingest(readingSet->getAllReadingsPtr(), newReadings);
-	const vector<Reading *>& readings = readingSet->getAllReadings();
-	for (vector<Reading *>::const_iterator elem = readings.begin();
-						      elem != readings.end();
-						      ++elem)
-	{
-		AssetTracker::getAssetTracker()->addAssetTrackingTuple(info->configCatName, (*elem)->getAssetName(), string("Filter"));
-	}
-
-	// Remove the input readingSet data
-	delete (ReadingSet *)readingSet;
-
+	// Add asset tracking tuples for the assets not seen before. The
+	// readings sent onwards are of assets that have been seen on input.
 	AssetTracker *tracker = AssetTracker::getAssetTracker();
-	// Create a new ReadingSet from new reading data
-	ReadingSet *newReadingSet = new ReadingSet(&newReadings);
-	const vector<Reading *>& readings2 = newReadingSet->getAllReadings();
-	for (vector<Reading *>::const_iterator elem = readings2.begin();
-						      elem != readings2.end();
-						      ++elem)
+	if (tracker)
 	{
-		if (tracker)
-		{
-			tracker->addAssetTrackingTuple(info->configCatName, (*elem)->getAssetName(), string("Filter"));
-		}
+		vector<string> added;
+		info->tracked.track(readingSet->getAllReadings(), added);
+		for (const auto &asset : added)
+			tracker->addAssetTrackingTuple(info->configCatName, asset, string("Filter"));
 	}
 
-	// Pass newReadings to filter->m_func
-	filter->m_func(filter->m_data, newReadingSet);
+	// The readings to forward are left in the set
+	filter->ingest((ReadingSet *)readingSet);
+
+	// Pass the readings onwards, measuring the downstream latency
+	filter->output((ReadingSet *)readingSet);
 }
 
 /**
  * Call the shutdown method in the plugin
  *
+ * The state of the assets is returned base64 encoded within a JSON
+ * document so that it can be restored by plugin_start.
+ *
  * @param handle	The plugin handle, aka instance of DeltaFilter
  * @return	A JSON string with data to persist in storage service
  */
-void plugin_shutdown(PLUGIN_HANDLE *handle)
+string plugin_shutdown(PLUGIN_HANDLE *handle)
 {
 	FILTER_INFO *info = (FILTER_INFO *) handle;
+	string state = info->handle->saveState();
 	delete info->handle;
 	delete info;
+	return string("{ \"state\" : \"") + base64Encode(state) + "\" }";
 }
 
 /**
@@ -228,6 +408,9 @@ void plugin_reconfigure(PLUGIN_HANDLE *handle, const string& newConfig)
 	FILTER_INFO *info = (FILTER_INFO *) handle;
 	DeltaFilter *filter = info->handle;
 	filter->reconfigure(newConfig);
+
+	// Track the assets again in case the tracker has been reset
+	info->tracked.clear();
 }
 
 /**
@@ -240,7 +423,23 @@ void plugin_reconfigure(PLUGIN_HANDLE *handle, const string& newConfig)
 void plugin_start(PLUGIN_HANDLE *handle,
 		  const string& storedData)
 {
-	FledgeFilter* filter = (FledgeFilter *)handle;
+	FILTER_INFO *info = (FILTER_INFO *) handle;
+	if (storedData.empty())
+	{
+		return;
+	}
+
+	Document doc;
+	string state;
+	doc.Parse(storedData.c_str());
+	if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("state")
+			|| !doc["state"].IsString()
+			|| !base64Decode(doc["state"].GetString(), state))
+	{
+		Logger::getLogger()->error("Unable to restore the state of the delta filter, the stored data is not valid");
+		return;
+	}
+	info->handle->restoreState(state);
 }
 
 // End of extern "C"
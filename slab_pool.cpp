@@ -0,0 +1,89 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <slab_pool.h>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * Constructor for the slab pool. No slab is allocated until the first
+ * object is.
+ */
+SlabPool::SlabPool() : m_current(NULL), m_remaining(0)
+{
+	memset(m_free, 0, sizeof(m_free));
+}
+
+/**
+ * Destructor for the slab pool, releases all the slabs
+ */
+SlabPool::~SlabPool()
+{
+	for (auto slab : m_slabs)
+	{
+		::operator delete(slab);
+	}
+}
+
+/**
+ * Allocate an object, reusing a freed object of the same size class if
+ * there is one
+ *
+ * @param size	The size of the object
+ * @return	The memory for the object
+ */
+void *
+SlabPool::allocate(size_t size)
+{
+	if (size == 0 || size > POOL_MAX_SIZE)
+		return ::operator new(size);
+
+	size_t sizeClass = (size - 1) / POOL_GRANULE;
+	FreeObject *object = m_free[sizeClass];
+	if (object)
+	{
+		m_free[sizeClass] = object->m_next;
+		return object;
+	}
+
+	size_t rounded = (sizeClass + 1) * POOL_GRANULE;
+	if (m_remaining < rounded)
+	{
+		// The remainder of the current slab is too small and is abandoned
+		m_current = (char *)::operator new(POOL_SLAB_SIZE);
+		m_slabs.push_back(m_current);
+		m_remaining = POOL_SLAB_SIZE;
+	}
+	void *ptr = m_current;
+	m_current += rounded;
+	m_remaining -= rounded;
+	return ptr;
+}
+
+/**
+ * Return an object to the free list of its size class
+ *
+ * @param ptr	The object
+ * @param size	The size of the object, as passed to allocate
+ */
+void
+SlabPool::release(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	if (size == 0 || size > POOL_MAX_SIZE)
+	{
+		::operator delete(ptr);
+		return;
+	}
+
+	size_t sizeClass = (size - 1) / POOL_GRANULE;
+	FreeObject *object = (FreeObject *)ptr;
+	object->m_next = m_free[sizeClass];
+	m_free[sizeClass] = object;
+}
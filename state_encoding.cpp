@@ -0,0 +1,272 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <state_encoding.h>
+#include <string.h>
+
+using namespace std;
+
+static const char base64Chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Append an unsigned integer as a variable length quantity
+ *
+ * @param value	The value to append
+ */
+void
+StateWriter::putVarint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		m_buffer.push_back((char)((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	m_buffer.push_back((char)value);
+}
+
+/**
+ * Append a signed integer, zig-zag encoded so that small negative
+ * values are also short
+ *
+ * @param value	The value to append
+ */
+void
+StateWriter::putSigned(int64_t value)
+{
+	putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+/**
+ * Append a double
+ *
+ * @param value	The value to append
+ */
+void
+StateWriter::putDouble(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 8; i++)
+	{
+		m_buffer.push_back((char)(bits & 0xff));
+		bits >>= 8;
+	}
+}
+
+/**
+ * Append a string, prefixed by its length
+ *
+ * @param value	The value to append
+ */
+void
+StateWriter::putString(const string& value)
+{
+	putVarint(value.size());
+	m_buffer.append(value);
+}
+
+/**
+ * Append a time
+ *
+ * @param value	The value to append
+ */
+void
+StateWriter::putTime(const struct timeval& value)
+{
+	putSigned(value.tv_sec);
+	putVarint(value.tv_usec);
+}
+
+/**
+ * Read a variable length unsigned integer
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted or malformed
+ */
+bool
+StateReader::getVarint(uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (m_ptr >= m_end)
+			return fail();
+		uint8_t byte = (uint8_t)*m_ptr++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return fail();
+}
+
+/**
+ * Read a zig-zag encoded signed integer
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted or malformed
+ */
+bool
+StateReader::getSigned(int64_t& value)
+{
+	uint64_t raw;
+	if (!getVarint(raw))
+		return false;
+	value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+	return true;
+}
+
+/**
+ * Read a double
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted
+ */
+bool
+StateReader::getDouble(double& value)
+{
+	if (m_end - m_ptr < 8)
+		return fail();
+	uint64_t bits = 0;
+	for (int i = 7; i >= 0; i--)
+		bits = (bits << 8) | (uint8_t)m_ptr[i];
+	m_ptr += 8;
+	memcpy(&value, &bits, sizeof(bits));
+	return true;
+}
+
+/**
+ * Read a string
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted or malformed
+ */
+bool
+StateReader::getString(string& value)
+{
+	uint64_t length;
+	if (!getVarint(length))
+		return false;
+	if ((uint64_t)(m_end - m_ptr) < length)
+		return fail();
+	value.assign(m_ptr, length);
+	m_ptr += length;
+	return true;
+}
+
+/**
+ * Read a time
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted or malformed
+ */
+bool
+StateReader::getTime(struct timeval& value)
+{
+	int64_t sec;
+	uint64_t usec;
+	if (!getSigned(sec) || !getVarint(usec))
+		return false;
+	if (usec >= 1000000)
+		return fail();
+	value.tv_sec = sec;
+	value.tv_usec = usec;
+	return true;
+}
+
+/**
+ * Read a single byte
+ *
+ * @param value	The value read
+ * @return	False if the data is exhausted
+ */
+bool
+StateReader::getByte(uint8_t& value)
+{
+	if (m_ptr >= m_end)
+		return fail();
+	value = (uint8_t)*m_ptr++;
+	return true;
+}
+
+/**
+ * Encode binary data as base64 so that it may be stored as a string
+ *
+ * @param data	The binary data
+ * @return	The base64 text
+ */
+string
+base64Encode(const string& data)
+{
+	string text;
+	text.reserve(((data.size() + 2) / 3) * 4);
+	size_t i = 0;
+	for (; i + 2 < data.size(); i += 3)
+	{
+		uint32_t n = ((uint8_t)data[i] << 16) | ((uint8_t)data[i + 1] << 8) | (uint8_t)data[i + 2];
+		text.push_back(base64Chars[(n >> 18) & 0x3f]);
+		text.push_back(base64Chars[(n >> 12) & 0x3f]);
+		text.push_back(base64Chars[(n >> 6) & 0x3f]);
+		text.push_back(base64Chars[n & 0x3f]);
+	}
+	if (i < data.size())
+	{
+		uint32_t n = (uint8_t)data[i] << 16;
+		if (i + 1 < data.size())
+			n |= (uint8_t)data[i + 1] << 8;
+		text.push_back(base64Chars[(n >> 18) & 0x3f]);
+		text.push_back(base64Chars[(n >> 12) & 0x3f]);
+		text.push_back(i + 1 < data.size() ? base64Chars[(n >> 6) & 0x3f] : '=');
+		text.push_back('=');
+	}
+	return text;
+}
+
+/**
+ * Decode base64 text back to binary data
+ *
+ * @param text	The base64 text
+ * @param data	The decoded binary data
+ * @return	False if the text is not valid base64
+ */
+bool
+base64Decode(const string& text, string& data)
+{
+	int8_t lookup[256];
+	memset(lookup, -1, sizeof(lookup));
+	for (int i = 0; i < 64; i++)
+		lookup[(uint8_t)base64Chars[i]] = i;
+
+	if (text.size() % 4 != 0)
+		return false;
+	data.clear();
+	data.reserve((text.size() / 4) * 3);
+	for (size_t i = 0; i < text.size(); i += 4)
+	{
+		uint32_t n = 0;
+		int padding = 0;
+		for (int j = 0; j < 4; j++)
+		{
+			char c = text[i + j];
+			if (c == '=' && i + 4 == text.size() && j >= 2)
+			{
+				padding++;
+				n <<= 6;
+				continue;
+			}
+			if (padding || lookup[(uint8_t)c] < 0)
+				return false;
+			n = (n << 6) | lookup[(uint8_t)c];
+		}
+		data.push_back((char)((n >> 16) & 0xff));
+		if (padding < 2)
+			data.push_back((char)((n >> 8) & 0xff));
+		if (padding < 1)
+			data.push_back((char)(n & 0xff));
+	}
+	return true;
+}
@@ -0,0 +1,644 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <state_segment.h>
+#include <logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <vector>
+
+#define SLOT_EMPTY	0	// Offsets used to mark index slots, records are never at these
+#define SLOT_DELETED	1
+#define RECORD_HEADER	(2 * sizeof(uint32_t))
+
+using namespace std;
+
+/**
+ * Constructor for the state segment, the segment is not attached
+ * to a file until attach is called.
+ */
+StateSegment::StateSegment() : m_fd(-1), m_base(NULL), m_size(0), m_needed(0),
+	m_generation(0), m_logRemovals(false)
+{
+}
+
+/**
+ * Destructor for the state segment
+ */
+StateSegment::~StateSegment()
+{
+	detach();
+}
+
+/**
+ * Hash a string using the 64 bit FNV-1a hash
+ *
+ * @param value	The string to hash
+ * @return	The hash value
+ */
+uint64_t
+StateSegment::hash(const string& value)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned char c : value)
+	{
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/**
+ * Attach to the segment in the given file, creating the file if required.
+ * If the file does not hold a valid segment with a matching configuration
+ * hash its contents are discarded.
+ *
+ * @param path		The path of the file
+ * @param configHash	The hash of the configuration the state depends upon
+ * @return	False if the file could not be created or mapped
+ */
+bool
+StateSegment::attach(const string& path, uint64_t configHash)
+{
+	Logger *logger = Logger::getLogger();
+
+	detach();
+	m_fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (m_fd == -1)
+	{
+		logger->error("Unable to open the delta filter state file %s: %s",
+				path.c_str(), strerror(errno));
+		return false;
+	}
+	m_path = path;
+
+	struct stat st;
+	if (fstat(m_fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header))
+	{
+		if (!map(st.st_size))
+		{
+			detach();
+			return false;
+		}
+		if (valid(configHash))
+		{
+			logger->info("Attached to the state of %lu assets in %s",
+					(unsigned long)header()->count, path.c_str());
+			return true;
+		}
+		logger->warn("The delta filter state file %s is not compatible with this configuration and has been discarded",
+				path.c_str());
+	}
+	clear(configHash);
+	return isAttached();
+}
+
+/**
+ * Unmap and close the segment file
+ */
+void
+StateSegment::detach()
+{
+	invalidate();
+	if (m_base)
+	{
+		msync(m_base, m_size, MS_SYNC);
+		munmap(m_base, m_size);
+		m_base = NULL;
+		m_size = 0;
+	}
+	if (m_fd != -1)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+	m_path.clear();
+}
+
+/**
+ * Set the size of the file and map it
+ *
+ * @param size	The required size of the file
+ * @return	False if the file could not be mapped
+ */
+bool
+StateSegment::map(size_t size)
+{
+	if (m_base)
+	{
+		munmap(m_base, m_size);
+		m_base = NULL;
+		m_size = 0;
+	}
+	if (ftruncate(m_fd, size) == -1)
+	{
+		Logger::getLogger()->error("Unable to size the delta filter state file %s: %s",
+				m_path.c_str(), strerror(errno));
+		return false;
+	}
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (base == MAP_FAILED)
+	{
+		Logger::getLogger()->error("Unable to map the delta filter state file %s: %s",
+				m_path.c_str(), strerror(errno));
+		return false;
+	}
+	m_base = (char *)base;
+	m_size = size;
+	return true;
+}
+
+/**
+ * Check the header of the mapped file
+ *
+ * @param configHash	The hash of the current configuration
+ * @return	True if the segment may be used
+ */
+bool
+StateSegment::valid(uint64_t configHash) const
+{
+	const Header *h = header();
+	return h->magic == SEGMENT_MAGIC && h->version == SEGMENT_VERSION
+		&& h->configHash == configHash && h->fileSize == m_size
+		&& h->slots != 0 && (h->slots & (h->slots - 1)) == 0
+		&& h->arenaStart == sizeof(Header) + h->slots * sizeof(Slot)
+		&& h->arenaStart + h->arenaUsed <= m_size;
+}
+
+/**
+ * Lay out an empty segment with the given index and arena sizes. The
+ * magic number is written last so that a partially written header is
+ * not mistaken for a valid one.
+ *
+ * @param configHash	The hash of the configuration
+ * @param slots		The number of index slots, a power of 2
+ * @param arena		The size of the arena in bytes
+ */
+void
+StateSegment::initialise(uint64_t configHash, uint64_t slots, uint64_t arena)
+{
+	Header *h = header();
+	h->magic = 0;
+	h->version = SEGMENT_VERSION;
+	h->configHash = configHash;
+	h->fileSize = sizeof(Header) + slots * sizeof(Slot) + arena;
+	h->slots = slots;
+	h->count = 0;
+	h->deleted = 0;
+	h->arenaStart = sizeof(Header) + slots * sizeof(Slot);
+	h->arenaUsed = 0;
+	h->garbage = 0;
+	memset(this->slots(), 0, slots * sizeof(Slot));
+	h->magic = SEGMENT_MAGIC;
+}
+
+/**
+ * Discard the contents of the segment
+ *
+ * @param configHash	The hash of the configuration the state will depend upon
+ */
+void
+StateSegment::clear(uint64_t configHash)
+{
+	if (m_fd == -1)
+		return;
+	invalidate();
+	if (!map(sizeof(Header) + SEGMENT_INITIAL_SLOTS * sizeof(Slot) + SEGMENT_INITIAL_ARENA))
+	{
+		detach();
+		return;
+	}
+	initialise(configHash, SEGMENT_INITIAL_SLOTS, SEGMENT_INITIAL_ARENA);
+}
+
+/**
+ * Return the number of assets held in the segment
+ */
+uint64_t
+StateSegment::getCount() const
+{
+	return m_base ? header()->count : 0;
+}
+
+/**
+ * Locate a record within the arena, checking that it lies within the file
+ *
+ * @return	False if the record is not valid
+ */
+bool
+StateSegment::record(uint64_t offset, const char *&name, uint32_t& nameLength,
+			const char *&data, uint32_t& dataLength) const
+{
+	const Header *h = header();
+	if (offset < h->arenaStart || offset + RECORD_HEADER > h->arenaStart + h->arenaUsed)
+		return false;
+	memcpy(&nameLength, m_base + offset, sizeof(uint32_t));
+	memcpy(&dataLength, m_base + offset + sizeof(uint32_t), sizeof(uint32_t));
+	if (offset + RECORD_HEADER + nameLength + dataLength > h->arenaStart + h->arenaUsed)
+		return false;
+	name = m_base + offset + RECORD_HEADER;
+	data = name + nameLength;
+	return true;
+}
+
+/**
+ * Find the index slot of an asset
+ *
+ * @param asset		The asset name
+ * @param hash		The hash of the asset name
+ * @param insert	If the asset is not present return the slot to insert it in
+ * @return	The slot or NULL if not found
+ */
+StateSegment::Slot *
+StateSegment::find(const string& asset, uint64_t hash, bool insert)
+{
+	uint64_t mask = header()->slots - 1;
+	Slot *free = NULL;
+	for (uint64_t i = 0, idx = hash & mask; i <= mask; i++, idx = (idx + 1) & mask)
+	{
+		Slot *slot = &slots()[idx];
+		if (slot->offset == SLOT_EMPTY)
+			return insert ? (free ? free : slot) : NULL;
+		if (slot->offset == SLOT_DELETED)
+		{
+			if (!free)
+				free = slot;
+			continue;
+		}
+		if (slot->hash != hash)
+			continue;
+		const char *name, *data;
+		uint32_t nameLength, dataLength;
+		if (record(slot->offset, name, nameLength, data, dataLength)
+				&& nameLength == asset.size()
+				&& memcmp(name, asset.data(), nameLength) == 0)
+			return slot;
+	}
+	return insert ? free : NULL;
+}
+
+/**
+ * Find the stored state of an asset. The data returned points into the
+ * segment and is valid until the segment is next modified.
+ *
+ * @param asset		The asset name
+ * @param data		The encoded state of the asset
+ * @param length	The length of the encoded state
+ * @return	False if the asset is not in the segment
+ */
+bool
+StateSegment::lookup(const string& asset, const char *&data, size_t& length)
+{
+	if (!m_base)
+		return false;
+	Slot *slot = find(asset, hash(asset), false);
+	if (!slot)
+		return false;
+	const char *name;
+	uint32_t nameLength, dataLength;
+	if (!record(slot->offset, name, nameLength, data, dataLength))
+		return false;
+	length = dataLength;
+	return true;
+}
+
+/**
+ * Store the state of an asset, replacing any previous state. The state
+ * is refused if the arena or the index is full, in which case the
+ * segment must be compacted before the state is stored again.
+ *
+ * @param asset		The asset name
+ * @param data		The encoded state of the asset
+ * @return	False if the state could not be stored
+ */
+bool
+StateSegment::store(const string& asset, const string& data)
+{
+	if (!m_base)
+		return false;
+	uint64_t needed = RECORD_HEADER + asset.size() + data.size();
+	Header *h = header();
+	if (h->arenaStart + h->arenaUsed + needed > h->fileSize
+			|| (h->count + h->deleted + 1) * 2 > h->slots)
+	{
+		// The compaction leaves space for at least this record
+		if (needed > m_needed)
+			m_needed = needed;
+		return false;
+	}
+	if (m_logRemovals)
+		invalidate();
+
+	uint64_t offset = h->arenaStart + h->arenaUsed;
+	uint32_t nameLength = asset.size(), dataLength = data.size();
+	memcpy(m_base + offset, &nameLength, sizeof(uint32_t));
+	memcpy(m_base + offset + sizeof(uint32_t), &dataLength, sizeof(uint32_t));
+	memcpy(m_base + offset + RECORD_HEADER, asset.data(), nameLength);
+	memcpy(m_base + offset + RECORD_HEADER + nameLength, data.data(), dataLength);
+	h->arenaUsed += needed;
+
+	uint64_t assetHash = hash(asset);
+	Slot *slot = find(asset, assetHash, true);
+	if (slot->offset == SLOT_DELETED)
+	{
+		h->deleted--;
+		h->count++;
+	}
+	else if (slot->offset == SLOT_EMPTY)
+	{
+		h->count++;
+	}
+	else
+	{
+		const char *name, *old;
+		uint32_t oldName, oldData;
+		if (record(slot->offset, name, oldName, old, oldData))
+			h->garbage += RECORD_HEADER + oldName + oldData;
+	}
+	slot->hash = assetHash;
+	slot->offset = offset;
+	return true;
+}
+
+/**
+ * Remove the state of an asset
+ *
+ * @param asset	The asset name
+ */
+void
+StateSegment::remove(const string& asset)
+{
+	if (!m_base)
+		return;
+	Slot *slot = find(asset, hash(asset), false);
+	if (!slot)
+		return;
+	const char *name, *data;
+	uint32_t nameLength, dataLength;
+	Header *h = header();
+	if (record(slot->offset, name, nameLength, data, dataLength))
+		h->garbage += RECORD_HEADER + nameLength + dataLength;
+	slot->offset = SLOT_DELETED;
+	h->count--;
+	h->deleted++;
+	if (m_logRemovals)
+		m_removed.push_back(asset);
+}
+
+/**
+ * Abandon any compaction in progress, called when the segment changes
+ * other than by the removal of an asset
+ */
+void
+StateSegment::invalidate()
+{
+	m_generation++;
+	m_logRemovals = false;
+	m_removed.clear();
+}
+
+/**
+ * Constructor for a compaction, which is started by beginCompaction
+ */
+StateSegment::Compaction::Compaction() : m_generation(0), m_configHash(0),
+	m_extra(0), m_slot(0), m_count(0), m_fd(-1), m_base(NULL), m_size(0)
+{
+}
+
+/**
+ * Destructor for a compaction, removes the new file if the compaction
+ * has not been installed
+ */
+StateSegment::Compaction::~Compaction()
+{
+	if (m_base)
+		munmap(m_base, m_size);
+	if (m_fd != -1)
+	{
+		close(m_fd);
+		unlink(m_path.c_str());
+	}
+}
+
+/**
+ * Compact the segment in a single step, dropping the garbage and deleted
+ * slots and growing it if required so that the record last refused by
+ * store fits. The segment is unchanged if the compaction fails.
+ *
+ * @return	False if the segment could not be compacted
+ */
+bool
+StateSegment::compact()
+{
+	if (!m_base)
+		return false;
+	Compaction compaction;
+	beginCompaction(compaction);
+	copyLive(compaction, header()->slots);
+	return writeCompaction(compaction) && installCompaction(compaction);
+}
+
+/**
+ * Start the compaction of the segment, abandoning any other compaction
+ * in progress. The assets removed from the segment are recorded from
+ * now on, so that they may be removed from the new file.
+ *
+ * @param compaction	The compaction
+ */
+void
+StateSegment::beginCompaction(Compaction& compaction)
+{
+	invalidate();
+	compaction.m_generation = m_generation;
+	compaction.m_slot = 0;
+	compaction.m_count = 0;
+	compaction.m_records.clear();
+	compaction.m_extra = m_needed;
+	m_needed = 0;
+	if (!m_base)
+		return;
+	const Header *h = header();
+	compaction.m_configHash = h->configHash;
+	compaction.m_path = m_path + SEGMENT_COMPACT_SUFFIX;
+	compaction.m_records.reserve(h->arenaUsed - h->garbage);
+	m_logRemovals = true;
+}
+
+/**
+ * Copy the live records held in the next index slots of the segment
+ * into a compaction
+ *
+ * @param compaction	The compaction
+ * @param slots		The maximum number of index slots to copy
+ * @return		True once all the slots have been copied or the
+ *			compaction has been abandoned
+ */
+bool
+StateSegment::copyLive(Compaction& compaction, uint64_t slots)
+{
+	if (compaction.m_generation != m_generation || !m_base)
+		return true;
+	const Header *h = header();
+	uint64_t end = h->slots;
+	if (slots < end - compaction.m_slot)
+		end = compaction.m_slot + slots;
+	for (; compaction.m_slot < end; compaction.m_slot++)
+	{
+		const Slot *slot = &this->slots()[compaction.m_slot];
+		const char *name, *data;
+		uint32_t nameLength, dataLength;
+		if (slot->offset > SLOT_DELETED
+				&& record(slot->offset, name, nameLength, data, dataLength))
+		{
+			compaction.m_records.append(m_base + slot->offset,
+					RECORD_HEADER + nameLength + dataLength);
+			compaction.m_count++;
+		}
+	}
+	return compaction.m_slot == h->slots;
+}
+
+/**
+ * Write the records copied into a compaction to its new file, sized
+ * so that the segment may double before it is compacted again, and
+ * wait for the file to be written to disk. The segment itself is not
+ * used, so this may be called without the lock on the segment.
+ *
+ * @param compaction	The compaction
+ * @return		False if the new file could not be written
+ */
+bool
+StateSegment::writeCompaction(Compaction& compaction)
+{
+	Logger *logger = Logger::getLogger();
+	if (compaction.m_path.empty())
+		return false;
+
+	uint64_t slotCount = SEGMENT_INITIAL_SLOTS;
+	while ((compaction.m_count + 1) * 4 > slotCount)
+		slotCount *= 2;
+	uint64_t arena = SEGMENT_INITIAL_ARENA;
+	while (arena < (compaction.m_records.size() + compaction.m_extra) * 2)
+		arena *= 2;
+	size_t size = sizeof(Header) + slotCount * sizeof(Slot) + arena;
+
+	compaction.m_fd = open(compaction.m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (compaction.m_fd == -1)
+	{
+		logger->error("Unable to create %s to compact the delta filter state: %s",
+				compaction.m_path.c_str(), strerror(errno));
+		return false;
+	}
+	if (ftruncate(compaction.m_fd, size) == -1)
+	{
+		logger->error("Unable to size %s to compact the delta filter state: %s",
+				compaction.m_path.c_str(), strerror(errno));
+		return false;
+	}
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, compaction.m_fd, 0);
+	if (base == MAP_FAILED)
+	{
+		logger->error("Unable to map %s to compact the delta filter state: %s",
+				compaction.m_path.c_str(), strerror(errno));
+		return false;
+	}
+	compaction.m_base = (char *)base;
+	compaction.m_size = size;
+
+	// The new file is zero filled, so the index starts with every slot empty
+	Header *h = (Header *)compaction.m_base;
+	h->magic = 0;
+	h->version = SEGMENT_VERSION;
+	h->configHash = compaction.m_configHash;
+	h->fileSize = size;
+	h->slots = slotCount;
+	h->count = compaction.m_count;
+	h->deleted = 0;
+	h->arenaStart = sizeof(Header) + slotCount * sizeof(Slot);
+	h->arenaUsed = compaction.m_records.size();
+	h->garbage = 0;
+	memcpy(compaction.m_base + h->arenaStart, compaction.m_records.data(), compaction.m_records.size());
+
+	Slot *slots = (Slot *)(compaction.m_base + sizeof(Header));
+	const char *records = compaction.m_records.data();
+	for (uint64_t offset = 0; offset < compaction.m_records.size(); )
+	{
+		uint32_t nameLength, dataLength;
+		memcpy(&nameLength, records + offset, sizeof(uint32_t));
+		memcpy(&dataLength, records + offset + sizeof(uint32_t), sizeof(uint32_t));
+		uint64_t assetHash = hash(string(records + offset + RECORD_HEADER, nameLength));
+		uint64_t idx = assetHash & (slotCount - 1);
+		while (slots[idx].offset != SLOT_EMPTY)
+			idx = (idx + 1) & (slotCount - 1);
+		slots[idx].hash = assetHash;
+		slots[idx].offset = h->arenaStart + offset;
+		offset += RECORD_HEADER + nameLength + dataLength;
+	}
+	h->magic = SEGMENT_MAGIC;
+
+	if (msync(compaction.m_base, size, MS_SYNC) == -1 || fsync(compaction.m_fd) == -1)
+	{
+		logger->error("Unable to write %s to compact the delta filter state: %s",
+				compaction.m_path.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Replace the segment with the new file written by a compaction. The
+ * assets removed since the compaction began are removed from the new
+ * file. A compaction that has been abandoned is discarded.
+ *
+ * @param compaction	The compaction
+ * @return		False if the segment has not been replaced
+ */
+bool
+StateSegment::installCompaction(Compaction& compaction)
+{
+	if (compaction.m_generation != m_generation || !m_base || !compaction.m_base)
+		return false;
+	if (rename(compaction.m_path.c_str(), m_path.c_str()) == -1)
+	{
+		Logger::getLogger()->error("Unable to replace the delta filter state file %s: %s",
+				m_path.c_str(), strerror(errno));
+		return false;
+	}
+	munmap(m_base, m_size);
+	close(m_fd);
+	m_base = compaction.m_base;
+	m_size = compaction.m_size;
+	m_fd = compaction.m_fd;
+	compaction.m_base = NULL;
+	compaction.m_fd = -1;
+
+	vector<string> removed;
+	removed.swap(m_removed);
+	invalidate();
+	for (auto& asset : removed)
+	{
+		remove(asset);
+	}
+	Logger::getLogger()->info("Compacted the state of %lu assets in %s into %lu bytes",
+			(unsigned long)header()->count, m_path.c_str(), (unsigned long)m_size);
+	return true;
+}
+
+/**
+ * Schedule the changes to the segment to be written to the file
+ */
+void
+StateSegment::sync()
+{
+	if (m_base)
+		msync(m_base, m_size, MS_ASYNC);
+}
@@ -1,3 +1,5 @@
+#include <plugin_api.h>
+#include <filter.h>
 #include "helper.h"
 
 using namespace std;
@@ -64,3 +66,76 @@ Reading *createReadingWithDoubleDatapoints(string assetName, const vector<string
     }
     return rdng;
 }
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle, READINGSET *readingSet);
+};
+
+/**
+ * Create the configuration of a filter that compares percentage changes
+ *
+ * @param tolerance	The tolerance as a percentage
+ * @param mode		The processing mode
+ */
+ConfigCategory *createDeltaConfig(const string &tolerance, const string &mode)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("delta", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", tolerance);
+    config->setValue("processingMode", mode);
+    config->setValue("enable", "true");
+    return config;
+}
+
+/**
+ * Ingest a set of readings and collect the readings the filter forwards,
+ * which are deleted
+ *
+ * @param handle	The filter handle
+ * @param outReadings	The readings set by the output handler
+ * @param readings	The readings to ingest, deleted by the call
+ */
+Forwarded ingestReadings(void *handle, ReadingSet **outReadings, vector<Reading *> *readings)
+{
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    Forwarded forwarded = { 0, 0, "" };
+    for (auto rdng : (*outReadings)->getAllReadings())
+    {
+        forwarded.readings++;
+        for (auto dp : rdng->getReadingData())
+        {
+            forwarded.datapoints++;
+            forwarded.names += (forwarded.names.empty() ? "" : ",") + dp->getName();
+        }
+    }
+    delete *outReadings;
+    *outReadings = NULL;
+    return forwarded;
+}
+
+/**
+ * Ingest a single reading with double datapoints and collect the readings
+ * the filter forwards
+ *
+ * @param handle	The filter handle
+ * @param outReadings	The readings set by the output handler
+ * @param assetName	The asset name of the reading
+ * @param dpNames	Vector of Datapoint names
+ * @param dpValues	Vector of Datapoint values aligned to dpNames vector
+ * @param userTimestamp	The user timestamp of the reading, if not the current time
+ */
+Forwarded ingestDoubles(void *handle, ReadingSet **outReadings, const string &assetName,
+        const vector<string> &dpNames, const vector<double> &dpValues, const struct timeval *userTimestamp)
+{
+    Reading *reading = createReadingWithDoubleDatapoints(assetName, dpNames, dpValues);
+    if (userTimestamp)
+        reading->setUserTimestamp(*userTimestamp);
+    return ingestReadings(handle, outReadings, new vector<Reading *>(1, reading));
+}
@@ -3,7 +3,10 @@
 
 #include <string>
 #include <vector>
+#include <sys/time.h>
 #include <reading.h>
+#include <reading_set.h>
+#include <config_category.h>
 
 using namespace std;
 
@@ -11,4 +14,19 @@ void addStringTypeDatapoint(Reading *rdng, const string &dpName, const string &d
 Reading *createReadingWithLongDatapoints(string assetName, const vector<string> &dpNames, const vector<long> &dpValues);
 Reading *createReadingWithDoubleDatapoints(string assetName, const vector<string> &dpNames, const vector<double> &dpValues);
 
+/**
+ * The readings forwarded by the filter for the readings ingested
+ */
+struct Forwarded {
+    int     readings;
+    int     datapoints;
+    string  names;      // The names of the datapoints forwarded, separated by commas
+};
+
+ConfigCategory *createDeltaConfig(const string &tolerance,
+        const string &mode = "Include full reading if any Datapoint exceeds tolerance");
+Forwarded ingestReadings(void *handle, ReadingSet **outReadings, vector<Reading *> *readings);
+Forwarded ingestDoubles(void *handle, ReadingSet **outReadings, const string &assetName,
+        const vector<string> &dpNames, const vector<double> &dpValues, const struct timeval *userTimestamp = NULL);
+
 #endif
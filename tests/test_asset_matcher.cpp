@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <asset_matcher.h>
+#include <string>
+
+using namespace std;
+
+/* TEST CASE : Asset names, prefixes, globs and regular expressions are
+ * matched with the exact name preferred over the patterns
+ */
+TEST(DELTA, AssetMatcherPatterns)
+{
+    AssetMatcher matcher;
+    ASSERT_TRUE(matcher.add("pump1", 1));
+    ASSERT_TRUE(matcher.add("site/*", 2));
+    ASSERT_TRUE(matcher.add("site/line1/*", 3));
+    ASSERT_TRUE(matcher.add("plant/line?/vibration", 4));
+    ASSERT_TRUE(matcher.add("plant/*/temp[0-9]", 5));
+    ASSERT_TRUE(matcher.add("regex:motor[0-9]+", 6));
+    ASSERT_TRUE(matcher.add("site/line1/pump", 7));
+    ASSERT_FALSE(matcher.add("regex:motor[", 8));
+
+    ASSERT_EQ(matcher.match("pump1"), 1);
+    ASSERT_EQ(matcher.match("pump2"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("site/line2/pump"), 2);
+    ASSERT_EQ(matcher.match("site/line1/pump2"), 3);
+    ASSERT_EQ(matcher.match("site/line1/pump"), 7);
+    ASSERT_EQ(matcher.match("plant/line3/vibration"), 4);
+    ASSERT_EQ(matcher.match("plant/line33/vibration"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("plant/a/b/temp4"), 5);
+    ASSERT_EQ(matcher.match("plant/a/b/tempx"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("motor12"), 6);
+    ASSERT_EQ(matcher.match("motor12a"), MATCH_NONE);
+
+    matcher.clear();
+    ASSERT_EQ(matcher.match("pump1"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("site/line2/pump"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("motor12"), MATCH_NONE);
+}
+
+/* TEST CASE : The glob with the longest fixed start is preferred and
+ * character classes may be negated
+ */
+TEST(DELTA, AssetMatcherGlobs)
+{
+    AssetMatcher matcher;
+    ASSERT_TRUE(matcher.add("*/vibration", 1));
+    ASSERT_TRUE(matcher.add("site/*/vibration", 2));
+    ASSERT_TRUE(matcher.add("line[!0-4]*", 3));
+    ASSERT_TRUE(matcher.add("a[b", 4));
+
+    ASSERT_EQ(matcher.match("site/line1/vibration"), 2);
+    ASSERT_EQ(matcher.match("plant/line1/vibration"), 1);
+    ASSERT_EQ(matcher.match("line5/pump"), 3);
+    ASSERT_EQ(matcher.match("line3/pump"), MATCH_NONE);
+    ASSERT_EQ(matcher.match("a[b"), 4);
+}
+
+/* TEST CASE : An asset whose name contains the characters used in globs
+ * matches the pattern that is its own name
+ */
+TEST(DELTA, AssetMatcherLiteralNames)
+{
+    AssetMatcher matcher;
+    ASSERT_TRUE(matcher.add("tag[1]", 1));
+    ASSERT_TRUE(matcher.add("tag[2]", 2));
+    ASSERT_TRUE(matcher.add("what?", 3));
+
+    ASSERT_EQ(matcher.match("tag[1]"), 1);
+    ASSERT_EQ(matcher.match("tag[2]"), 2);
+    ASSERT_EQ(matcher.match("tag1"), 1);
+    ASSERT_EQ(matcher.match("what?"), 3);
+    ASSERT_EQ(matcher.match("whats"), 3);
+}
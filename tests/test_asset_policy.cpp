@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Ingest a single reading of an asset with flow and status datapoints and
+ * return the number of datapoints forwarded
+ */
+static int ingestPump(void *handle, ReadingSet **outReadings, const string& asset,
+		double flow, double status)
+{
+    return ingestDoubles(handle, outReadings, asset, {"flow", "status"}, {flow, status}).datapoints;
+}
+
+/* TEST CASE : The processing mode and tolerance measure may be set for
+ * individual assets and for the assets that match a pattern
+ */
+TEST(DELTA, AssetProcessingPolicy)
+{
+    ConfigCategory *config = createDeltaConfig("10");
+    config->setValue("overrides", "{ \"pumpA\" : { \"processingMode\" : \"Include only the Datapoints that exceed tolerance\" }, "
+		    "\"line1/*\" : { \"toleranceMeasure\" : \"Absolute Value\", \"tolerance\" : 0.5 }, "
+		    "\"pumpC\" : { \"processingMode\" : \"No such mode\" } }");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 100.0, 1000.0), 2);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "line1/pumpB", 100.0, 1000.0), 2);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpC", 100.0, 1000.0), 2);
+
+    // Only the changed datapoint of pumpA is sent
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 120.0, 1000.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpC", 120.0, 1000.0), 2);
+
+    // A change of 0.6 in the flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "line1/pumpB", 100.6, 1000.0), 2);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpC", 120.6, 1000.0), 0);
+
+    plugin_shutdown(handle);
+    delete config;
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <delta_filter.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+static bool slowDownstream = false;
+
+static void SlowHandler(void *handle, READINGSET *readings)
+{
+    if (slowDownstream)
+        usleep(20000);
+    delete *(READINGSET **)handle;
+    *(READINGSET **)handle = readings;
+}
+
+static unsigned long ingestValue(void *handle, ReadingSet **outReadings, double value)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {value};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast", dpNames, dpValues));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+    return (*outReadings)->getAllReadings().size();
+}
+
+/* TEST CASE : While the downstream is slow a 5% change is shed because the
+ * 1% tolerance is scaled by 10, once the downstream recovers the tolerance
+ * decays back and the same change is sent again
+ */
+TEST(DELTA, BackPressureShedsReadings)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("backpressureLatency"), true);
+    config->setValue("backpressureLatency", "5");
+    ASSERT_EQ(config->itemExists("backpressureFactor"), true);
+    config->setValue("backpressureFactor", "10");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings = NULL;
+    void *handle = plugin_init(config, &outReadings, SlowHandler);
+
+    slowDownstream = true;
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0), 1);
+
+    slowDownstream = false;
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0), 0);
+
+    // Sending on empty sets quickly brings the average latency down
+    for (int i = 0; i < 20; i++)
+        ingestValue(handle, &outReadings, 100.0);
+
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0), 1);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/**
+ * Pass a reading with three datapoints through the filter and return the
+ * number of datapoints forwarded
+ */
+static int filterValues(DeltaFilter *filter, ReadingSet **outReadings, const vector<double>& values)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast", {"dp1", "dp2", "dp3"}, values));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    filter->ingest(readingSet);
+    filter->output(readingSet);
+    int datapoints = 0;
+    for (auto rdng : (*outReadings)->getAllReadings())
+        datapoints += rdng->getDatapointCount();
+    return datapoints;
+}
+
+/* TEST CASE : Each datapoint only suppressed because the tolerance is scaled
+ * is counted as shed, including those left out of a partial reading
+ */
+TEST(DELTA, BackPressureShedDatapoints)
+{
+    ConfigCategory *config = createDeltaConfig("1", "Include only the Datapoints that exceed tolerance");
+    config->setValue("backpressureLatency", "5");
+    config->setValue("backpressureFactor", "10");
+
+    ReadingSet *outReadings = NULL;
+    DeltaFilter *filter = new DeltaFilter("delta", *config, &outReadings, SlowHandler);
+
+    slowDownstream = true;
+    ASSERT_EQ(filterValues(filter, &outReadings, {100.0, 100.0, 49.0}), 3);
+    slowDownstream = false;
+
+    // dp1 exceeds the scaled tolerance, dp2 only the unscaled tolerance
+    ASSERT_EQ(filterValues(filter, &outReadings, {150.0, 105.0, 49.0}), 1);
+    ASSERT_EQ(filter->getShed(), 1);
+
+    // A change of dp3 of the tolerance, but for rounding, is not shed
+    ASSERT_EQ(filterValues(filter, &outReadings, {150.0, 105.0, 49.49}), 0);
+    ASSERT_EQ(filter->getShed(), 2);
+
+    // dp2 and dp3 only exceed the unscaled tolerance
+    ASSERT_EQ(filterValues(filter, &outReadings, {150.0, 105.0, 52.0}), 0);
+    ASSERT_EQ(filter->getShed(), 4);
+
+    delete filter;
+    delete outReadings;
+    delete config;
+}
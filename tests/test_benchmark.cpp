@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <delta_filter.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+/**
+ * Discard the readings sent onwards
+ */
+static void DiscardHandler(void *handle, READINGSET *readings)
+{
+    delete (ReadingSet *)readings;
+}
+
+/**
+ * Time the ingest of a number of batches of readings of a set of assets,
+ * either in runs of the same asset or interleaved round robin
+ *
+ * @param assets	The number of assets
+ * @param run		The number of consecutive readings of each asset
+ * @param group		Group the readings by asset before they are evaluated
+ * @return		The time per reading in nanoseconds
+ */
+static double timeIngest(int assets, int run, bool group = false)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("bench", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("groupByAsset", group ? "true" : "false");
+    config->setValue("enable", "true");
+    void *handle = plugin_init(config, NULL, DiscardHandler);
+
+    const int batches = 20, batchSize = 10000;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {100.0};
+    chrono::steady_clock::duration elapsed(0);
+    for (int b = 0; b < batches; b++)
+    {
+        vector<Reading *> *readings = new vector<Reading *>;
+        for (int i = 0; i < batchSize; i++)
+        {
+            int asset = (i / run) % assets;
+            readings->emplace_back(createReadingWithDoubleDatapoints("benchmark-asset-" + to_string(asset), dpNames, dpValues));
+        }
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        plugin_ingest(handle, (READINGSET *)readingSet);
+        elapsed += chrono::steady_clock::now() - start;
+    }
+    plugin_shutdown(handle);
+    delete config;
+    return chrono::duration<double, nano>(elapsed).count() / (batches * batchSize);
+}
+
+/* BENCHMARK : The cost per reading of batches made of runs of the same
+ * asset compared with batches that interleave the assets. Run with
+ * --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+ */
+TEST(DELTA, DISABLED_BenchmarkAssetRuns)
+{
+    for (int assets : {10, 1000, 10000})
+    {
+        double runs = timeIngest(assets, 100);
+        double interleaved = timeIngest(assets, 1);
+        cout << assets << " assets: " << runs << "ns per reading in runs of 100, "
+            << interleaved << "ns per reading interleaved" << endl;
+    }
+}
+
+/* BENCHMARK : The cost per reading of batches that interleave the assets
+ * when processed in order and when grouped by asset
+ */
+TEST(DELTA, DISABLED_BenchmarkGroupByAsset)
+{
+    for (int assets : {10, 1000, 10000})
+    {
+        double ordered = timeIngest(assets, 1);
+        double grouped = timeIngest(assets, 1, true);
+        cout << assets << " interleaved assets: " << ordered << "ns per reading in order, "
+            << grouped << "ns per reading grouped" << endl;
+    }
+}
+
+/**
+ * Return the resident set size of the process in kilobytes
+ */
+static long residentSize()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* BENCHMARK : The resident set size over a synthetic day of readings in
+ * which assets come and go, with the state limited to 5000 assets and
+ * idle assets expired after an hour. The reading timestamps advance by a
+ * simulated minute per set, the RSS should level off once the state has
+ * reached its limit.
+ */
+TEST(DELTA, DISABLED_BenchmarkResidentSize)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("bench", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("maxAssets", "5000");
+    config->setValue("stateExpiry", "3600");
+    config->setValue("enable", "true");
+    DeltaFilter *filter = new DeltaFilter("delta", *config, NULL, DiscardHandler);
+
+    vector<string> dpNames = {"temperature", "pressure", "status"};
+    for (int minute = 0; minute < 24 * 60; minute++)
+    {
+        vector<Reading *> *readings = new vector<Reading *>;
+        for (int i = 0; i < 2000; i++)
+        {
+            // A drifting population of assets with changing values
+            int asset = (minute * 50 + i * 7) % 20000;
+            vector<double> dpValues = {20.0 + (minute + i) % 10, 1000.0 + i % 5, (double)(minute % 3)};
+            Reading *reading = createReadingWithDoubleDatapoints("asset-" + to_string(asset), dpNames, dpValues);
+            struct timeval tm = { 1700000000 + minute * 60, i };
+            reading->setUserTimestamp(tm);
+            readings->emplace_back(reading);
+        }
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+        filter->ingest(readingSet);
+        filter->output(readingSet);
+        if (minute % 60 == 59)
+        {
+            cout << "hour " << minute / 60 + 1 << ": RSS " << residentSize() << "KB, "
+                << filter->getSlabCount() << " slabs" << endl;
+        }
+    }
+    delete filter;
+    delete config;
+}
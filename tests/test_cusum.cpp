@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/* TEST CASE : Forward a reading once a slow sustained shift, that never
+ * exceeds the tolerance between two readings, has accumulated beyond the
+ * absolute tolerance of 10
+ */
+TEST(DELTA, CumulativeSumSustainedShift)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    ASSERT_EQ(config->itemExists("toleranceMeasure"), true);
+    config->setValue("toleranceMeasure", "Absolute Value");
+
+    ASSERT_EQ(config->itemExists("tolerance"), true);
+    config->setValue("tolerance", "10");
+
+    ASSERT_EQ(config->itemExists("processingMode"), true);
+    config->setValue("processingMode", "Include full reading if cumulative change of any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("drift"), true);
+    config->setValue("drift", "0");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    vector<string> dpNames = {"dp1", "dp2"};
+
+    vector<long> dpValues = {100, 100};
+    readings->emplace_back(createReadingWithLongDatapoints("ast", dpNames, dpValues));
+
+    dpValues = {104, 100};
+    readings->emplace_back(createReadingWithLongDatapoints("ast", dpNames, dpValues));
+
+    dpValues = {104, 100};
+    readings->emplace_back(createReadingWithLongDatapoints("ast", dpNames, dpValues));
+
+    dpValues = {104, 100};
+    readings->emplace_back(createReadingWithLongDatapoints("ast", dpNames, dpValues));
+
+    // Cumulative sums restart from the new reference value of 104
+    dpValues = {104, 100};
+    readings->emplace_back(createReadingWithLongDatapoints("ast", dpNames, dpValues));
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 2);
+
+    Reading *out = results[0];
+    ASSERT_STREQ(out->getAssetName().c_str(), "ast");
+    ASSERT_EQ(out->getDatapointCount(), 2);
+    Datapoint *outdp = out->getDatapoint("dp1");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_EQ(outdp->getData().toInt(), 100);
+
+    out = results[1];
+    ASSERT_STREQ(out->getAssetName().c_str(), "ast");
+    ASSERT_EQ(out->getDatapointCount(), 2);
+    outdp = out->getDatapoint("dp1");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_EQ(outdp->getData().toInt(), 104);
+    outdp = out->getDatapoint("dp2");
+    ASSERT_NE(outdp, (Datapoint *)NULL);
+    ASSERT_EQ(outdp->getData().toInt(), 100);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : Isolated noise spikes below the tolerance decay away with a
+ * drift allowance of 2 and do not cause a reading to be forwarded, a
+ * negative shift is detected by the lower cumulative sum
+ */
+TEST(DELTA, CumulativeSumDriftIgnoresSpikes)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Absolute Value");
+    config->setValue("tolerance", "10");
+    config->setValue("processingMode", "Include full reading if cumulative change of any Datapoint exceeds tolerance");
+    config->setValue("drift", "2");
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    vector<string> dpNames = {"dp1"};
+
+    vector<double> values = {100.0, 109.0, 100.0, 100.0, 100.0, 100.0, 109.0, 100.0, 94.0, 94.0, 94.0};
+    for (double value : values)
+    {
+        vector<double> dpValues = {value};
+        readings->emplace_back(createReadingWithDoubleDatapoints("ast", dpNames, dpValues));
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 2);
+
+    Reading *out = results[0];
+    ASSERT_EQ(out->getDatapointCount(), 1);
+    ASSERT_EQ(out->getDatapoint("dp1")->getData().toDouble(), 100.0);
+
+    // Lower sum: 4, 8, 12 on the third reading of 94
+    out = results[1];
+    ASSERT_EQ(out->getDatapointCount(), 1);
+    ASSERT_EQ(out->getDatapoint("dp1")->getData().toDouble(), 94.0);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    void plugin_reconfigure(PLUGIN_HANDLE handle, const string& newConfig);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Ingest a single reading of an asset with flow and status datapoints and
+ * return the number of readings forwarded
+ */
+static int ingestPump(void *handle, ReadingSet **outReadings, const string& asset,
+		double flow, double status)
+{
+    return ingestDoubles(handle, outReadings, asset, {"flow", "status"}, {flow, status}).readings;
+}
+
+static ConfigCategory *createConfig(const string& overrides)
+{
+    ConfigCategory *config = createDeltaConfig("10");
+    config->setValue("overrides", overrides);
+    return config;
+}
+
+/* TEST CASE : The datapoints of an asset given their own tolerances are
+ * compared with those, other assets use the global tolerance
+ */
+TEST(DELTA, DatapointToleranceOverrides)
+{
+    ConfigCategory *config = createConfig("{ \"pump1\" : { \"flow\" : 0.5, \"status\" : 0 } }");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.0, 1000.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump2", 100.0, 1000.0), 1);
+
+    // 0.6% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.6, 1000.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump2", 100.6, 1000.0), 0);
+
+    // 0.1% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.7, 1000.0), 0);
+
+    // Any change of status
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.7, 1001.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump2", 100.6, 1001.0), 0);
+
+    // The overrides are removed
+    config->setValue("overrides", "{ }");
+    plugin_reconfigure(handle, config->itemsToJSON());
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 101.5, 1002.0), 0);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 120.0, 1002.0), 1);
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : An asset tolerance applies to the datapoints that are not
+ * given their own, which may be given in a datapoints object
+ */
+TEST(DELTA, DatapointToleranceWithAssetTolerance)
+{
+    ConfigCategory *config = createConfig("{ \"pump1\" : { \"tolerance\" : 0.1, \"datapoints\" : { \"flow\" : 5 } } }");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.0, 1000.0), 1);
+
+    // 4% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 104.0, 1000.0), 0);
+
+    // 0.2% change of status
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 104.0, 1002.0), 1);
+
+    // 6% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 110.5, 1002.0), 1);
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : Overrides given as patterns apply to all the assets that
+ * match them and an exact asset name is preferred
+ */
+TEST(DELTA, PatternToleranceOverrides)
+{
+    ConfigCategory *config = createConfig("{ \"site/*\" : 0.5, \"site/line?/pump\" : { \"status\" : 0 }, "
+		    "\"regex:tank[0-9]+\" : 1, \"site/line1/pump2\" : 20 }");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    const vector<string> assets = {"site/line1/pump1", "site/line2/pump", "tank12", "site/line1/pump2", "pump1"};
+    for (const auto& asset : assets)
+        ASSERT_EQ(ingestPump(handle, &outReadings, asset, 100.0, 1000.0), 1);
+
+    // 0.6% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "site/line1/pump1", 100.6, 1000.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "site/line2/pump", 100.6, 1000.0), 0);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "tank12", 100.6, 1000.0), 0);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump1", 100.6, 1000.0), 0);
+
+    // 0.1% change of status
+    ASSERT_EQ(ingestPump(handle, &outReadings, "site/line2/pump", 100.6, 1001.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "site/line1/pump1", 100.6, 1001.0), 0);
+
+    // 15% change of flow
+    ASSERT_EQ(ingestPump(handle, &outReadings, "tank12", 115.0, 1000.0), 1);
+    ASSERT_EQ(ingestPump(handle, &outReadings, "site/line1/pump2", 115.0, 1000.0), 0);
+
+    plugin_shutdown(handle);
+    delete config;
+}
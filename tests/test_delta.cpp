@@ -19,7 +19,7 @@ extern "C" {
     PLUGIN_HANDLE plugin_init(ConfigCategory* config,
               OUTPUT_HANDLE *outHandle,
               OUTPUT_STREAM output);
-    void plugin_shutdown(PLUGIN_HANDLE handle);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
     int called = 0;
 
     void Handler(void *handle, READINGSET *readings)
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+/**
+ * Record the size of each set of readings sent onwards, in order
+ */
+static void ChunkHandler(void *handle, READINGSET *readings)
+{
+    vector<size_t> *chunks = (vector<size_t> *)handle;
+    chunks->push_back(readings->getAllReadings().size());
+    delete (ReadingSet *)readings;
+}
+
+/* TEST CASE : The readings of a large set are sent onwards in chunks while
+ * the rest of the set is evaluated
+ */
+TEST(DELTA, EarlyEmitChunks)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    ASSERT_EQ(config->itemExists("emitCount"), true);
+    config->setValue("emitCount", "100");
+    config->setValue("enable", "true");
+
+    vector<size_t> chunks;
+    void *handle = plugin_init(config, &chunks, ChunkHandler);
+
+    // Every other reading is a repeat of the previous value and is suppressed
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    for (int i = 0; i < 1050; i++)
+    {
+        vector<double> dpValues = {100.0 + i / 2};
+        readings->emplace_back(createReadingWithDoubleDatapoints("asset-" + to_string(i / 2), dpNames, dpValues));
+    }
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    ASSERT_EQ(chunks.size(), 6);
+    for (int i = 0; i < 5; i++)
+        ASSERT_EQ(chunks[i], 100);
+    ASSERT_EQ(chunks[5], 25);
+
+    plugin_shutdown(handle);
+    delete config;
+}
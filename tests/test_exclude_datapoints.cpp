@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Ingest a single reading of an asset with flow, status and sequence
+ * datapoints and return the names of the datapoints forwarded
+ */
+static string ingestPump(void *handle, ReadingSet **outReadings, const string& asset,
+		double flow, double status, double seq)
+{
+    return ingestDoubles(handle, outReadings, asset, {"flow", "status", "seq"}, {flow, status, seq}).names;
+}
+
+/* TEST CASE : An excluded counter does not cause readings to be sent but
+ * is sent with the readings that are sent
+ */
+TEST(DELTA, ExcludedDatapointNotCompared)
+{
+    ConfigCategory *config = createDeltaConfig("10", "Include full reading if any Datapoint exceeds tolerance");
+    ASSERT_EQ(config->itemExists("excludeDatapoints"), true);
+    config->setValue("excludeDatapoints", "[ \"seq\" ]");
+    config->setValue("overrides", "{ \"pumpB\" : { \"excludeDatapoints\" : [ ] } }");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 100.0, 1000.0, 1.0), "flow,status,seq");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpB", 100.0, 1000.0, 1.0), "flow,status,seq");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 101.0, 1000.0, 2.0), "");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 102.0, 1000.0, 3.0), "");
+
+    // The override compares all the datapoints of pumpB
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpB", 101.0, 1000.0, 2.0), "flow,status,seq");
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pumpA", 120.0, 1000.0, 4.0), "flow,status,seq");
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : Datapoints that are not included are not compared, but are
+ * sent with the changed datapoints
+ */
+TEST(DELTA, IncludedDatapointsOnlyChanged)
+{
+    ConfigCategory *config = createDeltaConfig("10", "Include only the Datapoints that exceed tolerance");
+    ASSERT_EQ(config->itemExists("includeDatapoints"), true);
+    config->setValue("includeDatapoints", "[ \"flow\", \"status\" ]");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 100.0, 1000.0, 1.0), "flow,status,seq");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 100.0, 1000.0, 2.0), "");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 120.0, 1000.0, 3.0), "flow,seq");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 150.0, 1200.0, 4.0), "flow,status,seq");
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : When all datapoints must change only the compared datapoints
+ * are considered
+ */
+TEST(DELTA, ExcludedDatapointAllChange)
+{
+    ConfigCategory *config = createDeltaConfig("10", "Include full reading if all Datapoints exceed tolerance");
+    config->setValue("excludeDatapoints", "[ \"seq\" ]");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 100.0, 1000.0, 1.0), "flow,status,seq");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 120.0, 1000.0, 1.0), "");
+    ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 120.0, 1200.0, 1.0), "flow,status,seq");
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : A reading none of whose datapoints are compared is never a
+ * change of all its datapoints, even when the repeat check is bypassed
+ * by a target rate
+ */
+TEST(DELTA, NoIncludedDatapoints)
+{
+    const vector<string> modes = {"Include full reading if all Datapoints exceed tolerance",
+		    "Include only the Datapoints that exceed tolerance"};
+    for (const auto& mode : modes)
+    {
+        ConfigCategory *config = createDeltaConfig("10", mode);
+        config->setValue("includeDatapoints", "[ \"level\" ]");
+        config->setValue("targetRate", "1");
+        config->setValue("targetRateUnit", "per second");
+        ReadingSet *outReadings;
+        void *handle = plugin_init(config, &outReadings, Handler);
+
+        ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 100.0, 1000.0, 1.0), "flow,status,seq");
+        ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 100.0, 1000.0, 1.0), "");
+        ASSERT_EQ(ingestPump(handle, &outReadings, "pump", 200.0, 2000.0, 2.0), "");
+
+        plugin_shutdown(handle);
+        delete config;
+    }
+}
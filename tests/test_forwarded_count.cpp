@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Ingest readings of a single flow datapoint of the given assets and
+ * values, the set forwarded is left in outReadings
+ */
+static void ingestFlows(void *handle, const vector<string>& assets, const vector<double>& values)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    for (size_t i = 0; i < assets.size(); i++)
+        readings->push_back(createReadingWithDoubleDatapoints(assets[i], {"flow"}, {values[i]}));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+}
+
+/* TEST CASE : The count of the set of readings passed onwards is that of
+ * the readings it holds once some of them have been suppressed, whether
+ * or not the readings are grouped by asset
+ */
+TEST(DELTA, ForwardedSetCount)
+{
+    for (const string groupByAsset : {"false", "true"})
+    {
+        ConfigCategory *config = createDeltaConfig("10");
+        config->setValue("groupByAsset", groupByAsset);
+        ReadingSet *outReadings = NULL;
+        void *handle = plugin_init(config, &outReadings, Handler);
+
+        ingestFlows(handle, {"pump", "pump", "pump", "pump", "pump", "valve", "pump"},
+                {100.0, 100.0, 100.0, 100.0, 100.0, 100.0, 150.0});
+        ASSERT_EQ(outReadings->getAllReadings().size(), 3);
+        ASSERT_EQ(outReadings->getCount(), outReadings->getAllReadings().size());
+        delete outReadings;
+
+        // A set of which nothing is forwarded has a count of zero
+        ingestFlows(handle, {"pump", "valve"}, {150.0, 100.0});
+        ASSERT_EQ(outReadings->getAllReadings().size(), 0);
+        ASSERT_EQ(outReadings->getCount(), 0);
+        delete outReadings;
+
+        plugin_shutdown(handle);
+        delete config;
+    }
+}
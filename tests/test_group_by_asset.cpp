@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+/**
+ * Record the asset and value of each reading sent onwards, in order
+ */
+static void RecordHandler(void *handle, READINGSET *readings)
+{
+    vector<string> *sent = (vector<string> *)handle;
+    for (auto reading : readings->getAllReadings())
+        sent->push_back(reading->getAssetName() + "=" + to_string(reading->getReadingData()[0]->getData().toDouble()));
+    delete (ReadingSet *)readings;
+}
+
+/**
+ * Send sets of readings that interleave a number of assets through a
+ * filter and return the readings sent onwards
+ */
+static vector<string> runInterleaved(bool groupByAsset)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "5");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("groupByAsset", groupByAsset ? "true" : "false");
+    config->setValue("enable", "true");
+
+    vector<string> sent;
+    void *handle = plugin_init(config, &sent, RecordHandler);
+    vector<string> dpNames = {"dp1"};
+    for (int set = 0; set < 5; set++)
+    {
+        vector<Reading *> *readings = new vector<Reading *>;
+        for (int i = 0; i < 200; i++)
+        {
+            // Each asset steps its value every few readings
+            int asset = i % 7;
+            vector<double> dpValues = {100.0 + 10 * ((set * 200 + i) / (7 * (asset + 1)))};
+            readings->emplace_back(createReadingWithDoubleDatapoints("asset-" + to_string(asset), dpNames, dpValues));
+        }
+        ReadingSet *readingSet = new ReadingSet(readings);
+        readings->clear();
+        delete readings;
+        plugin_ingest(handle, (READINGSET *)readingSet);
+    }
+    plugin_shutdown(handle);
+    delete config;
+    return sent;
+}
+
+/* TEST CASE : Grouping the readings by asset forwards the same readings,
+ * in the same order, as processing them in the order received
+ */
+TEST(DELTA, GroupByAssetKeepsOrder)
+{
+    vector<string> ungrouped = runInterleaved(false);
+    vector<string> grouped = runInterleaved(true);
+    ASSERT_GT(ungrouped.size(), 7);
+    ASSERT_LT(ungrouped.size(), 1000);
+    ASSERT_EQ(grouped, ungrouped);
+}
@@ -0,0 +1,391 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <mutex>
+#include <map>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <timing_wheel.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+static mutex countMutex;
+static map<string, int> counts;
+static map<string, double> lastValues;
+
+static void CountingHandler(void *handle, READINGSET *readings)
+{
+    lock_guard<mutex> guard(countMutex);
+    for (auto rdng : ((ReadingSet *)readings)->getAllReadings())
+    {
+        counts[rdng->getAssetName()]++;
+        lastValues[rdng->getAssetName()] = rdng->getDatapoint("dp1")->getData().toDouble();
+    }
+    delete (ReadingSet *)readings;
+}
+
+static vector<string> recordedNames;
+static vector<struct timeval> recordedTimes;
+
+static void RecordingHandler(void *handle, READINGSET *readings)
+{
+    lock_guard<mutex> guard(countMutex);
+    for (auto rdng : ((ReadingSet *)readings)->getAllReadings())
+    {
+        string names;
+        for (auto dp : rdng->getReadingData())
+            names += (names.empty() ? "" : ",") + dp->getName();
+        recordedNames.push_back(names);
+        struct timeval tm;
+        rdng->getUserTimestamp(&tm);
+        recordedTimes.push_back(tm);
+    }
+    delete (ReadingSet *)readings;
+}
+
+static vector<double> recordedValues;
+
+static void ValueHandler(void *handle, READINGSET *readings)
+{
+    lock_guard<mutex> guard(countMutex);
+    for (auto rdng : ((ReadingSet *)readings)->getAllReadings())
+        recordedValues.push_back(rdng->getDatapoint("dp1")->getData().toDouble());
+    delete (ReadingSet *)readings;
+}
+
+/* TEST CASE : Assets that stop reporting are sent again at the minimum rate
+ * with the last values that were sent
+ */
+TEST(DELTA, HeartbeatForSilentAssets)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("minRate", "20");
+    config->setValue("rateUnit", "per second");
+
+    config->setValue("enable", "true");
+
+    counts.clear();
+    lastValues.clear();
+    void *handle = plugin_init(config, NULL, CountingHandler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {100.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast1", dpNames, dpValues));
+    dpValues = {200.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast2", dpNames, dpValues));
+    dpValues = {205.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast2", dpNames, dpValues));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    {
+        lock_guard<mutex> guard(countMutex);
+        ASSERT_EQ(counts["ast1"], 1);
+        ASSERT_EQ(counts["ast2"], 2);
+    }
+
+    usleep(280000);
+
+    plugin_shutdown(handle);
+
+    // A heartbeat roughly every 50ms, allow for a busy machine
+    ASSERT_GE(counts["ast1"], 3);
+    ASSERT_LE(counts["ast1"], 7);
+    ASSERT_GE(counts["ast2"], 4);
+    ASSERT_LE(counts["ast2"], 8);
+    ASSERT_EQ(lastValues["ast1"], 100.0);
+    ASSERT_EQ(lastValues["ast2"], 205.0);
+
+    delete config;
+}
+
+/* TEST CASE : No heartbeat is sent for an asset that keeps reporting
+ * values within the tolerance, the newest value is sent at the minimum rate
+ */
+TEST(DELTA, NoHeartbeatWhileReporting)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    config->setValue("minRate", "4");
+    config->setValue("rateUnit", "per second");
+
+    recordedValues.clear();
+    void *handle = plugin_init(config, NULL, ValueHandler);
+
+    vector<string> dpNames = {"dp1"};
+    for (int i = 0; i < 26; i++)
+    {
+        vector<Reading *> *readings = new vector<Reading *>;
+        vector<double> dpValues = {100.0 + i * 0.01};
+        readings->emplace_back(createReadingWithDoubleDatapoints("ast", dpNames, dpValues));
+        plugin_ingest(handle, (READINGSET *)new ReadingSet(readings));
+        delete readings;
+        usleep(50000);
+    }
+
+    plugin_shutdown(handle);
+
+    // The first reading and then a newer value roughly every 250ms, a
+    // heartbeat would repeat the value sent before it
+    ASSERT_GE(recordedValues.size(), 4);
+    ASSERT_LE(recordedValues.size(), 7);
+    for (size_t i = 1; i < recordedValues.size(); i++)
+        ASSERT_GT(recordedValues[i], recordedValues[i - 1]);
+
+    delete config;
+}
+
+/* TEST CASE : A minimum rate set for an asset in the overrides sends
+ * heartbeats for that asset only
+ */
+TEST(DELTA, HeartbeatPerAssetRate)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("minRate", "0");
+    config->setValue("overrides", "{ \"ast1\" : { \"minRate\" : 20, \"rateUnit\" : \"per second\" } }");
+
+    config->setValue("enable", "true");
+
+    counts.clear();
+    lastValues.clear();
+    void *handle = plugin_init(config, NULL, CountingHandler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {100.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast1", dpNames, dpValues));
+    dpValues = {200.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast2", dpNames, dpValues));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    usleep(280000);
+
+    plugin_shutdown(handle);
+
+    // A heartbeat roughly every 50ms, allow for a busy machine
+    ASSERT_GE(counts["ast1"], 3);
+    ASSERT_LE(counts["ast1"], 7);
+    ASSERT_EQ(counts["ast2"], 1);
+
+    delete config;
+}
+
+/* TEST CASE : Heartbeats repeat the datapoints that are not compared and
+ * their timestamps follow on from the last reading sent at the minimum rate
+ */
+TEST(DELTA, HeartbeatExcludedDatapoints)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    config->setValue("minRate", "20");
+    config->setValue("rateUnit", "per second");
+    config->setValue("excludeDatapoints", "[ \"seq\" ]");
+
+    recordedNames.clear();
+    recordedTimes.clear();
+    void *handle = plugin_init(config, NULL, RecordingHandler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1", "seq"};
+    vector<double> dpValues = {100.0, 1.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("ast", dpNames, dpValues));
+    struct timeval first;
+    readings->back()->getUserTimestamp(&first);
+    plugin_ingest(handle, (READINGSET *)new ReadingSet(readings));
+    delete readings;
+
+    usleep(180000);
+    plugin_shutdown(handle);
+
+    // The reading sent and then its heartbeats, which follow on from the
+    // time the asset was first seen
+    ASSERT_GE(recordedNames.size(), 3);
+    struct timeval elapsed;
+    timersub(&recordedTimes[1], &first, &elapsed);
+    ASSERT_EQ(elapsed.tv_sec, 0);
+    ASSERT_GE(elapsed.tv_usec, 50000);
+    ASSERT_LT(elapsed.tv_usec, 60000);
+    for (size_t i = 0; i < recordedNames.size(); i++)
+    {
+        ASSERT_EQ(recordedNames[i], "dp1,seq");
+        if (i < 2)
+            continue;
+        timersub(&recordedTimes[i], &recordedTimes[i - 1], &elapsed);
+        ASSERT_EQ(elapsed.tv_sec, 0);
+        ASSERT_EQ(elapsed.tv_usec, 50000);
+    }
+
+    delete config;
+}
+
+/* TEST CASE : No heartbeat is sent while a changed value is held back by
+ * the maximum rate
+ */
+TEST(DELTA, HeartbeatWithHeldBackReading)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    config->setValue("minRate", "20");
+    config->setValue("rateUnit", "per second");
+    config->setValue("maxRate", "1");
+    config->setValue("maxRateUnit", "per second");
+    config->setValue("coalesce", "true");
+
+    counts.clear();
+    lastValues.clear();
+    void *handle = plugin_init(config, NULL, CountingHandler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    for (double value : {100.0, 200.0, 300.0})
+    {
+        vector<double> dpValues = {value};
+        readings->emplace_back(createReadingWithDoubleDatapoints("ast", dpNames, dpValues));
+    }
+    plugin_ingest(handle, (READINGSET *)new ReadingSet(readings));
+    delete readings;
+
+    usleep(150000);
+    {
+        // The value 300 is held back and is not sent as a heartbeat
+        lock_guard<mutex> guard(countMutex);
+        ASSERT_EQ(counts["ast"], 2);
+        ASSERT_EQ(lastValues["ast"], 200.0);
+    }
+
+    // The held back value is sent when the filter shuts down
+    plugin_shutdown(handle);
+    ASSERT_EQ(counts["ast"], 3);
+    ASSERT_EQ(lastValues["ast"], 300.0);
+
+    delete config;
+}
+
+/* TEST CASE : A value held back by the maximum rate is sent once a token
+ * is available although the asset stops reporting, or as soon as the
+ * state of the asset is evicted
+ */
+TEST(DELTA, HeldBackReadingSent)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    config->setValue("maxRate", "5");
+    config->setValue("maxRateUnit", "per second");
+    config->setValue("coalesce", "true");
+    config->setValue("overrides", "{ \"slow\" : { \"maxRate\" : 1, \"maxRateUnit\" : \"per minute\" } }");
+    config->setValue("maxAssets", "2");
+
+    counts.clear();
+    lastValues.clear();
+    void *handle = plugin_init(config, NULL, CountingHandler);
+
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    for (int i = 1; i <= 8; i++)
+    {
+        vector<double> dpValues = {i * 100.0};
+        readings->emplace_back(createReadingWithDoubleDatapoints("fast", dpNames, dpValues));
+        readings->emplace_back(createReadingWithDoubleDatapoints("slow", dpNames, dpValues));
+    }
+    plugin_ingest(handle, (READINGSET *)new ReadingSet(readings));
+    delete readings;
+
+    // The first reading and those a full bucket of tokens allows
+    {
+        lock_guard<mutex> guard(countMutex);
+        ASSERT_EQ(counts["fast"], 6);
+        ASSERT_EQ(counts["slow"], 2);
+    }
+
+    // A token is available for the fast asset after 200ms
+    usleep(300000);
+    {
+        lock_guard<mutex> guard(countMutex);
+        ASSERT_EQ(counts["fast"], 7);
+        ASSERT_EQ(lastValues["fast"], 800.0);
+        ASSERT_EQ(counts["slow"], 2);
+    }
+
+    // A new asset evicts the least recently used slow asset
+    readings = new vector<Reading *>;
+    vector<double> dpValues = {1.0};
+    readings->emplace_back(createReadingWithDoubleDatapoints("fast", dpNames, {800.0}));
+    readings->emplace_back(createReadingWithDoubleDatapoints("new", dpNames, dpValues));
+    plugin_ingest(handle, (READINGSET *)new ReadingSet(readings));
+    delete readings;
+    usleep(100000);
+    {
+        lock_guard<mutex> guard(countMutex);
+        ASSERT_EQ(counts["slow"], 3);
+        ASSERT_EQ(lastValues["slow"], 800.0);
+    }
+
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : Timers in every level of the timing wheel expire on exactly
+ * the tick they were scheduled for
+ */
+TEST(DELTA, TimingWheelExpiry)
+{
+    TimingWheel wheel;
+    vector<uint64_t> expiries = {1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 300000};
+    vector<TimingWheel::Timer> timers(expiries.size());
+    for (size_t i = 0; i < expiries.size(); i++)
+        wheel.schedule(&timers[i], expiries[i]);
+
+    // Cancelled timers do not expire
+    TimingWheel::Timer cancelled;
+    wheel.schedule(&cancelled, 100);
+    wheel.cancel(&cancelled);
+    ASSERT_EQ(cancelled.isScheduled(), false);
+
+    int fired = 0;
+    for (uint64_t tick = 1; tick <= 300000; tick++)
+    {
+        vector<TimingWheel::Timer *> expired;
+        wheel.advance(tick, expired);
+        for (auto timer : expired)
+        {
+            ASSERT_EQ(timer->getExpiry(), tick);
+            ASSERT_EQ(timer->isScheduled(), false);
+            fired++;
+        }
+    }
+    ASSERT_EQ(fired, expiries.size());
+}
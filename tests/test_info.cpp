@@ -2,6 +2,7 @@
 #include <plugin_api.h>
 #include <string.h>
 #include <string>
+#include <set>
 #include <rapidjson/document.h>
 
 using namespace std;
@@ -27,3 +28,20 @@ TEST(DELTA_INFO, PluginInfoConfigParse)
     ASSERT_EQ(doc.IsObject(), true);
     ASSERT_EQ(doc.HasMember("plugin"), true);
 }
+
+TEST(DELTA_INFO, PluginInfoConfigOrder)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    Document doc;
+    doc.Parse(info->config);
+    ASSERT_EQ(doc.HasParseError(), false);
+    set<int> orders;
+    for (auto &item : doc.GetObject())
+    {
+        if (!item.value.HasMember("order"))
+            continue;
+        int order = atoi(item.value["order"].GetString());
+        ASSERT_TRUE(orders.insert(order).second) << item.name.GetString();
+    }
+    ASSERT_EQ(doc["enable"]["order"].GetString(), string("7"));
+}
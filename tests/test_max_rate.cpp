@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Create a reading with a single double datapoint and the given user timestamp
+ */
+static Reading *timedReading(const string& asset, double value, long msec)
+{
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {value};
+    Reading *rdng = createReadingWithDoubleDatapoints(asset, dpNames, dpValues);
+    struct timeval tm = { 1700000000 + msec / 1000, (msec % 1000) * 1000 };
+    rdng->setUserTimestamp(tm);
+    return rdng;
+}
+
+/* TEST CASE : A value that changes on every reading, 10 times a second, is
+ * limited to 1 reading per second by the maximum rate
+ */
+TEST(DELTA, MaxRateLimitsChangingValues)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("maxRate"), true);
+    config->setValue("maxRate", "1");
+    ASSERT_EQ(config->itemExists("maxRateUnit"), true);
+    config->setValue("maxRateUnit", "per second");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    for (int i = 0; i < 30; i++)
+    {
+        readings->emplace_back(timedReading("ast", 100.0 + i * 10, i * 100));
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    // The first reading, then one each at 0.1, 1.1 and 2.1 seconds
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 4);
+    ASSERT_EQ(results[0]->getDatapoint("dp1")->getData().toDouble(), 100.0);
+    ASSERT_EQ(results[1]->getDatapoint("dp1")->getData().toDouble(), 110.0);
+    ASSERT_EQ(results[2]->getDatapoint("dp1")->getData().toDouble(), 210.0);
+    ASSERT_EQ(results[3]->getDatapoint("dp1")->getData().toDouble(), 310.0);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : A maximum rate set for one asset in the overrides holds back
+ * a changed value and sends it once the rate allows, even though the value
+ * did not change again. Other assets are not limited.
+ */
+TEST(DELTA, MaxRateCoalescePerAsset)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("overrides", "{ \"ast\" : { \"tolerance\" : 1, \"maxRate\" : 1, \"maxRateUnit\" : \"per second\" } }");
+
+    ASSERT_EQ(config->itemExists("coalesce"), true);
+    config->setValue("coalesce", "true");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    readings->emplace_back(timedReading("ast", 100.0, 0));
+    readings->emplace_back(timedReading("other", 100.0, 0));
+    readings->emplace_back(timedReading("ast", 200.0, 100));
+    readings->emplace_back(timedReading("other", 200.0, 100));
+    readings->emplace_back(timedReading("ast", 300.0, 200));
+    readings->emplace_back(timedReading("other", 300.0, 200));
+    for (int i = 3; i < 15; i++)
+    {
+        readings->emplace_back(timedReading("ast", 300.0, i * 100));
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 6);
+    ASSERT_STREQ(results[4]->getAssetName().c_str(), "other");
+    ASSERT_EQ(results[4]->getDatapoint("dp1")->getData().toDouble(), 300.0);
+
+    // The held back value is sent, with its own timestamp, once a token is
+    // available at 1.1 seconds
+    ASSERT_STREQ(results[5]->getAssetName().c_str(), "ast");
+    ASSERT_EQ(results[5]->getDatapoint("dp1")->getData().toDouble(), 300.0);
+    struct timeval ts;
+    results[5]->getUserTimestamp(&ts);
+    ASSERT_EQ(ts.tv_sec, 1700000000);
+    ASSERT_EQ(ts.tv_usec, 200000);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <mutex>
+#include <unistd.h>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+static mutex batchMutex;
+
+/**
+ * Record the size of each set of readings sent onwards
+ */
+static void BatchHandler(void *handle, READINGSET *readings)
+{
+    vector<size_t> *batches = (vector<size_t> *)handle;
+    lock_guard<mutex> guard(batchMutex);
+    batches->push_back(readings->getAllReadings().size());
+    delete (ReadingSet *)readings;
+}
+
+static size_t batchCount(vector<size_t>& batches)
+{
+    lock_guard<mutex> guard(batchMutex);
+    return batches.size();
+}
+
+/* TEST CASE : Readings are collected across calls and sent onwards when
+ * the batch size is reached or the batch has been held for the latency
+ */
+TEST(DELTA, OutputBatching)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    ASSERT_EQ(config->itemExists("outputBatch"), true);
+    config->setValue("outputBatch", "10");
+    config->setValue("outputBatchLatency", "50");
+    config->setValue("enable", "true");
+
+    vector<size_t> batches;
+    void *handle = plugin_init(config, &batches, BatchHandler);
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {100.0};
+    for (int i = 0; i < 25; i++)
+    {
+        for (int repeat = 0; repeat < 2; repeat++)
+        {
+            vector<Reading *> *readings = new vector<Reading *>;
+            readings->emplace_back(createReadingWithDoubleDatapoints("asset-" + to_string(i), dpNames, dpValues));
+            ReadingSet *readingSet = new ReadingSet(readings);
+            readings->clear();
+            delete readings;
+            plugin_ingest(handle, (READINGSET *)readingSet);
+        }
+    }
+
+    // The repeated values are suppressed and their empty sets not sent
+    ASSERT_EQ(batchCount(batches), 2);
+    usleep(150000);
+    ASSERT_EQ(batchCount(batches), 3);
+    plugin_shutdown(handle);
+
+    ASSERT_EQ(batches[0], 10);
+    ASSERT_EQ(batches[1], 10);
+    ASSERT_EQ(batches[2], 5);
+    delete config;
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/* TEST CASE : A steadily ramping value sampled 10 times a second with a
+ * tolerance of zero would forward every reading, a target output rate of
+ * 60 readings per minute widens the tolerance until the rate is met
+ */
+TEST(DELTA, OutputBudgetLimitsRate)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Absolute Value");
+    config->setValue("tolerance", "0");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("targetRate"), true);
+    config->setValue("targetRate", "60");
+    ASSERT_EQ(config->itemExists("targetRateUnit"), true);
+    config->setValue("targetRateUnit", "per minute");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    vector<string> dpNames = {"dp1"};
+    struct timeval tm = { 1700000000, 0 };
+    for (int i = 0; i < 600; i++)
+    {
+        vector<double> dpValues = {(double)i};
+        Reading *rdng = createReadingWithDoubleDatapoints("ast", dpNames, dpValues);
+        rdng->setUserTimestamp(tm);
+        readings->emplace_back(rdng);
+        tm.tv_usec += 100000;
+        if (tm.tv_usec >= 1000000)
+        {
+            tm.tv_sec++;
+            tm.tv_usec -= 1000000;
+        }
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_LT(results.size(), 150);
+
+    // Once settled the rate over the last 30 seconds is close to 1 per second
+    int settled = 0;
+    for (auto rdng : results)
+    {
+        struct timeval ts;
+        rdng->getUserTimestamp(&ts);
+        if (ts.tv_sec >= 1700000030)
+            settled++;
+    }
+    ASSERT_LE(settled, 45);
+    ASSERT_GE(settled, 15);
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <output_queue.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+};
+
+static ReadingSet *createSet(const string& asset, double value)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {value};
+    readings->emplace_back(createReadingWithDoubleDatapoints(asset, dpNames, dpValues));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    return readingSet;
+}
+
+/**
+ * A slow downstream element that records the assets it is sent, in order
+ */
+static void SlowHandler(void *handle, READINGSET *readings)
+{
+    vector<string> *assets = (vector<string> *)handle;
+    usleep(2000);
+    for (auto reading : readings->getAllReadings())
+        assets->push_back(reading->getAssetName());
+    delete (ReadingSet *)readings;
+}
+
+/* TEST CASE : The sets of readings are removed from the output queue in
+ * the order they were added and the depth never exceeds the capacity
+ */
+TEST(DELTA, OutputQueueOrder)
+{
+    OutputQueue queue(3);
+    ASSERT_EQ(queue.getCapacity(), 4);
+
+    thread producer([&queue] {
+        for (int i = 0; i < 1000; i++)
+            queue.push(createSet("asset-" + to_string(i), i));
+        queue.stop();
+    });
+
+    int count = 0;
+    ReadingSet *readings;
+    while ((readings = queue.pop()) != NULL)
+    {
+        ASSERT_EQ(readings->getAllReadings()[0]->getAssetName(), "asset-" + to_string(count));
+        delete readings;
+        count++;
+    }
+    producer.join();
+    ASSERT_EQ(count, 1000);
+    ASSERT_LE(queue.getMaxDepth(), 4);
+    ASSERT_EQ(queue.getDepth(), 0);
+}
+
+/* TEST CASE : Readings sent onwards through the output queue keep their
+ * order and those still queued are sent when the filter shuts down
+ */
+TEST(DELTA, OutputQueueDelivery)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    config->setItemsValueFromDefault();
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    ASSERT_EQ(config->itemExists("outputQueue"), true);
+    config->setValue("outputQueue", "2");
+    config->setValue("enable", "true");
+
+    vector<string> assets;
+    void *handle = plugin_init(config, &assets, SlowHandler);
+    for (int i = 0; i < 20; i++)
+    {
+        plugin_ingest(handle, (READINGSET *)createSet("asset-" + to_string(i), 100.0));
+        // An unchanged value gives an empty set, which is still queued
+        plugin_ingest(handle, (READINGSET *)createSet("asset-" + to_string(i), 100.0));
+    }
+    plugin_shutdown(handle);
+
+    ASSERT_EQ(assets.size(), 20);
+    for (int i = 0; i < 20; i++)
+        ASSERT_EQ(assets[i], "asset-" + to_string(i));
+    delete config;
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    void plugin_start(PLUGIN_HANDLE handle, const string& storedData);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Create a reading with an integer, a floating point and a string datapoint
+ */
+static Reading *mixedReading(const string& asset, long i, double f, const string& s)
+{
+    vector<Datapoint *> dps;
+    DatapointValue iv(i);
+    dps.push_back(new Datapoint("count", iv));
+    DatapointValue fv(f);
+    dps.push_back(new Datapoint("level", fv));
+    DatapointValue sv(s);
+    dps.push_back(new Datapoint("state", sv));
+    return new Reading(asset, dps);
+}
+
+/* TEST CASE : The reference values are saved on shutdown and restored on
+ * start, so unchanged readings are not forwarded after a restart
+ */
+TEST(DELTA, PersistStateRoundTrip)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    ASSERT_NE(plugin_info()->options & SP_PERSIST_DATA, 0);
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    readings->emplace_back(mixedReading("pump1", -42, 3.25, "running"));
+    readings->emplace_back(mixedReading("pump2", 1L << 40, -1e-3, ""));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, 2);
+    string stored = plugin_shutdown(handle);
+
+    Document doc;
+    doc.Parse(stored.c_str());
+    ASSERT_FALSE(doc.HasParseError());
+    ASSERT_TRUE(doc.HasMember("state"));
+
+    handle = plugin_init(config, &outReadings, Handler);
+    plugin_start(handle, stored);
+
+    readings = new vector<Reading *>;
+    readings->emplace_back(mixedReading("pump1", -42, 3.25, "running"));
+    readings->emplace_back(mixedReading("pump2", 1L << 40, -1e-3, ""));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, 0);
+
+    readings = new vector<Reading *>;
+    readings->emplace_back(mixedReading("pump1", -42, 3.25, "stopped"));
+    readings->emplace_back(mixedReading("pump3", 0, 0.0, "new"));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, 2);
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : A large state is saved and restored quickly */
+TEST(DELTA, PersistLargeState)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    const int assets = 10000;
+    vector<Reading *> *readings = new vector<Reading *>;
+    for (int i = 0; i < assets; i++)
+        readings->emplace_back(mixedReading("asset-" + to_string(i), i, i * 0.5, "ok"));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, assets);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string stored = plugin_shutdown(handle);
+    handle = plugin_init(config, &outReadings, Handler);
+    plugin_start(handle, stored);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    ASSERT_LT(elapsed, 5000.0);
+
+    readings = new vector<Reading *>;
+    for (int i = 0; i < assets; i++)
+        readings->emplace_back(mixedReading("asset-" + to_string(i), i, i * 0.5, "ok"));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, 0);
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : Stored data that is not valid is ignored */
+TEST(DELTA, PersistCorruptStateIgnored)
+{
+    ConfigCategory *config = createDeltaConfig("1");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+    readings->emplace_back(mixedReading("pump1", 1, 1.0, "on"));
+    ingestReadings(handle, &outReadings, readings);
+    string stored = plugin_shutdown(handle);
+
+    // Truncate the encoded state
+    size_t end = stored.find("\" }");
+    ASSERT_NE(end, string::npos);
+    string truncated = stored.substr(0, end - 8) + stored.substr(end);
+
+    handle = plugin_init(config, &outReadings, Handler);
+    plugin_start(handle, truncated);
+    plugin_start(handle, "{ \"state\" : \"not base64!\" }");
+    plugin_start(handle, "not json");
+
+    readings = new vector<Reading *>;
+    readings->emplace_back(mixedReading("pump1", 1, 1.0, "on"));
+    ASSERT_EQ(ingestReadings(handle, &outReadings, readings).readings, 1);
+
+    delete config;
+    plugin_shutdown(handle);
+}
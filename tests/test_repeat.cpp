@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    void plugin_reconfigure(PLUGIN_HANDLE handle, const string& newConfig);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+static struct timeval base;
+
+/**
+ * Ingest a single reading with the given value and user timestamp, in
+ * milliseconds after the start of the test, and return the number of
+ * readings forwarded
+ */
+static int ingestValue(void *handle, ReadingSet **outReadings, double value, long msec)
+{
+    struct timeval offset = { msec / 1000, (msec % 1000) * 1000 }, tm;
+    timeradd(&base, &offset, &tm);
+    return ingestDoubles(handle, outReadings, "repeat", {"dp1", "dp2"}, {value, 50.0}, &tm).readings;
+}
+
+static ConfigCategory *createConfig(const string& tolerance, const string& minRate)
+{
+    ConfigCategory *config = createDeltaConfig(tolerance);
+    config->setValue("minRate", minRate);
+    config->setValue("rateUnit", "per second");
+    return config;
+}
+
+/* TEST CASE : Repeated readings are dropped, but still sent once the
+ * minimum rate deadline has passed
+ */
+TEST(DELTA, RepeatedReadingsDropped)
+{
+    gettimeofday(&base, NULL);
+    ConfigCategory *config = createConfig("10", "0");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 0), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 100), 0);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0, 200), 0);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0, 300), 0);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 120.0, 400), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 120.0, 500), 0);
+    plugin_shutdown(handle);
+    delete config;
+
+    config = createConfig("10", "1");
+    handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 0), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 0), 0);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 2000), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 2100), 0);
+    plugin_shutdown(handle);
+    delete config;
+}
+
+/* TEST CASE : A repeated reading is evaluated again after the tolerance
+ * has been reconfigured
+ */
+TEST(DELTA, RepeatedReadingAfterReconfigure)
+{
+    gettimeofday(&base, NULL);
+    ConfigCategory *config = createConfig("10", "0");
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 100.0, 0), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0, 100), 0);
+
+    config->setValue("tolerance", "1");
+    plugin_reconfigure(handle, config->itemsToJSON());
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0, 200), 1);
+    ASSERT_EQ(ingestValue(handle, &outReadings, 105.0, 300), 0);
+    plugin_shutdown(handle);
+    delete config;
+}
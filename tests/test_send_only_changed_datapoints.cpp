@@ -20,7 +20,7 @@ extern "C" {
     PLUGIN_HANDLE plugin_init(ConfigCategory* config,
               OUTPUT_HANDLE *outHandle,
               OUTPUT_STREAM output);
-    void plugin_shutdown(PLUGIN_HANDLE handle);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
     extern void Handler(void *handle, READINGSET *readings);
 };
 
@@ -408,3 +408,59 @@ TEST(DELTA, PercentNegativeValuesSendOnlyChangedDatapoints)
     delete config;
     plugin_shutdown(handle);
 }
+
+/* TEST CASE : An unchanged datapoint is sent along with the changed
+ * datapoints once it has not been sent for longer than the minimum rate
+ */
+TEST(DELTA, SendOnlyChangedDatapointsRefreshesStaleDatapoints)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Absolute Value");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include only the Datapoints that exceed tolerance");
+    config->setValue("minRate", "1");
+    config->setValue("rateUnit", "per second");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    vector<Reading *> *readings = new vector<Reading *>;
+
+    // dp1 changes on every reading, dp2 never changes
+    vector<string> dpNames = {"dp1", "dp2"};
+    struct timeval tm = { 1700000000, 0 };
+    for (int i = 0; i < 25; i++)
+    {
+        vector<double> dpValues = {(double)(i * 10), 50.0};
+        Reading *rdng = createReadingWithDoubleDatapoints("ast", dpNames, dpValues);
+        tm.tv_sec = 1700000000 + i / 10;
+        tm.tv_usec = (i % 10) * 100000;
+        rdng->setUserTimestamp(tm);
+        readings->emplace_back(rdng);
+    }
+
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<Reading *>results = outReadings->getAllReadings();
+    ASSERT_EQ(results.size(), 25);
+
+    // dp2 is sent with the first reading and then at 1.1 and 2.2 seconds
+    for (int i = 0; i < 25; i++)
+    {
+        bool withDp2 = (i == 0 || i == 11 || i == 22);
+        ASSERT_NE(results[i]->getDatapoint("dp1"), (Datapoint *)NULL);
+        ASSERT_EQ(results[i]->getDatapoint("dp2") != NULL, withDp2) << "reading " << i;
+    }
+
+    delete outReadings;
+    delete config;
+    plugin_shutdown(handle);
+}
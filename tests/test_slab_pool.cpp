@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <slab_pool.h>
+#include <delta_filter.h>
+#include <string>
+#include <map>
+#include "helper.h"
+
+using namespace std;
+
+/* TEST CASE : Freed objects are reused by the next allocation of the
+ * same size class and objects of different sizes do not share memory
+ */
+TEST(DELTA, SlabPoolReuse)
+{
+    SlabPool pool;
+    void *a = pool.allocate(40);
+    void *b = pool.allocate(40);
+    void *c = pool.allocate(200);
+    ASSERT_NE(a, b);
+    ASSERT_EQ((size_t)a % POOL_GRANULE, 0);
+    ASSERT_EQ((size_t)c % POOL_GRANULE, 0);
+
+    pool.release(a, 40);
+    ASSERT_EQ(pool.allocate(48), a);	// Same size class
+    pool.release(c, 200);
+    void *d = pool.allocate(40);
+    ASSERT_NE(d, c);
+
+    pool.release(a, 48);
+    pool.release(b, 40);
+    pool.release(d, 40);
+
+    // Large objects are not held in the pool
+    void *large = pool.allocate(POOL_MAX_SIZE + 1);
+    ASSERT_NE(large, (void *)NULL);
+    pool.release(large, POOL_MAX_SIZE + 1);
+}
+
+/* TEST CASE : A map whose nodes come from the pool does not allocate
+ * further slabs once it has reached its size, however often entries are
+ * removed and added
+ */
+TEST(DELTA, SlabPoolMapChurn)
+{
+    typedef map<int, string, less<int>, PoolAllocator<pair<const int, string> > > PoolMap;
+    SlabPool pool;
+    PoolMap values((PoolMap::allocator_type(pool)));
+    for (int i = 0; i < 1000; i++)
+        values[i] = "value";
+    size_t slabs = pool.getSlabCount();
+    ASSERT_GT(slabs, 0);
+    for (int i = 0; i < 100000; i++)
+    {
+        values.erase(i);
+        values[i + 1000] = "value";
+    }
+    ASSERT_EQ(pool.getSlabCount(), slabs);
+}
+
+/* TEST CASE : Each instance of the filter allocates the state of its
+ * assets from its own pool
+ */
+TEST(DELTA, SlabPoolPerFilter)
+{
+    ConfigCategory *config = createDeltaConfig("10");
+    DeltaFilter *first = new DeltaFilter("delta", *config, NULL, NULL);
+    DeltaFilter *second = new DeltaFilter("delta", *config, NULL, NULL);
+    ASSERT_EQ(first->getSlabCount(), 0);
+
+    vector<Reading *> readings;
+    for (int i = 0; i < 100; i++)
+        readings.push_back(createReadingWithDoubleDatapoints("asset" + to_string(i), {"dp1", "dp2"}, {1.0, 2.0}));
+    first->ingest(&readings);
+    ASSERT_EQ(readings.size(), 100);
+    ASSERT_EQ(first->getAssetCount(), 100);
+    ASSERT_GT(first->getSlabCount(), 0);
+    ASSERT_EQ(second->getSlabCount(), 0);
+    for (auto reading : readings)
+        delete reading;
+
+    delete first;
+    delete second;
+    delete config;
+}
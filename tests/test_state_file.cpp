@@ -0,0 +1,310 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <fstream>
+#include <iterator>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include <delta_filter.h>
+#include <state_segment.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    void plugin_start(PLUGIN_HANDLE handle, const string& storedData);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+static ConfigCategory *createConfig(const string& stateFile, const string& mode)
+{
+    ConfigCategory *config = createDeltaConfig("1", mode);
+    config->setValue("stateFile", stateFile);
+    return config;
+}
+
+static int ingestAssets(void *handle, ReadingSet **outReadings, int first, int count, double value)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {value};
+    for (int i = first; i < first + count; i++)
+        readings->emplace_back(createReadingWithDoubleDatapoints("asset-" + to_string(i), dpNames, dpValues));
+    return ingestReadings(handle, outReadings, readings).readings;
+}
+
+/* TEST CASE : A restarted filter attaches to the state held in the state
+ * file and does not forward unchanged readings
+ */
+TEST(DELTA, StateFileWarmRestart)
+{
+    string path = "/tmp/delta_state_" + to_string(getpid());
+    unlink(path.c_str());
+    ConfigCategory *config = createConfig(path, "Include full reading if any Datapoint exceeds tolerance");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 5000, 100.0), 5000);
+    string stored = plugin_shutdown(handle);
+
+    handle = plugin_init(config, &outReadings, Handler);
+    plugin_start(handle, stored);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 5000, 100.0), 0);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 10, 110.0), 10);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 5000, 10, 100.0), 10);
+    stored = plugin_shutdown(handle);
+
+    // The changed values were stored on shutdown
+    handle = plugin_init(config, &outReadings, Handler);
+    plugin_start(handle, stored);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 10, 110.0), 0);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 5000, 10, 100.0), 0);
+    plugin_shutdown(handle);
+
+    delete config;
+    unlink(path.c_str());
+}
+
+/* TEST CASE : The state file is discarded if the configuration it depends
+ * upon has changed
+ */
+TEST(DELTA, StateFileDiscardedOnConfigChange)
+{
+    string path = "/tmp/delta_state_" + to_string(getpid());
+    unlink(path.c_str());
+    ConfigCategory *config = createConfig(path, "Include full reading if any Datapoint exceeds tolerance");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 10, 100.0), 10);
+    plugin_shutdown(handle);
+    delete config;
+
+    config = createConfig(path, "Include full reading if all Datapoints exceed tolerance");
+    handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 10, 100.0), 10);
+    plugin_shutdown(handle);
+
+    delete config;
+    unlink(path.c_str());
+}
+
+static string readFile(const string& path)
+{
+    ifstream in(path, ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+static void writeFile(const string& path, const string& contents)
+{
+    ofstream out(path, ios::binary | ios::trunc);
+    out << contents;
+}
+
+/* TEST CASE : The changed state is checkpointed to the state file in the
+ * background, so a filter that does not shut down cleanly loses little
+ */
+TEST(DELTA, StateFileCheckpoint)
+{
+    string path = "/tmp/delta_state_" + to_string(getpid());
+    unlink(path.c_str());
+    ConfigCategory *config = createConfig(path, "Include full reading if any Datapoint exceeds tolerance");
+
+    // Without checkpoints nothing is written until shutdown
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 200, 100.0), 200);
+    string crashed = readFile(path);
+    plugin_shutdown(handle);
+    writeFile(path, crashed);
+
+    handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 200, 100.0), 200);
+    plugin_shutdown(handle);
+    unlink(path.c_str());
+
+    // Take a copy of the state file as it would be left by a crash
+    config->setValue("checkpointInterval", "0.02");
+    handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 200, 100.0), 200);
+    usleep(100000);
+    crashed = readFile(path);
+    plugin_shutdown(handle);
+    writeFile(path, crashed);
+
+    handle = plugin_init(config, &outReadings, Handler);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, 0, 200, 100.0), 0);
+    plugin_shutdown(handle);
+
+    delete config;
+    unlink(path.c_str());
+}
+
+/**
+ * Ingest a reading of each of a range of assets directly into a filter
+ * and return the number of readings forwarded
+ */
+static int filterAssets(DeltaFilter *filter, int first, int count, double value)
+{
+    vector<Reading *> readings;
+    for (int i = first; i < first + count; i++)
+        readings.push_back(createReadingWithDoubleDatapoints("asset-" + to_string(i), {"dp1"}, {value}));
+    filter->ingest(&readings);
+    for (auto reading : readings)
+        delete reading;
+    return readings.size();
+}
+
+/* TEST CASE : A full state segment refuses further state until it is
+ * compacted into a new file, which replaces the segment file
+ */
+TEST(DELTA, StateSegmentCompaction)
+{
+    string path = "/tmp/delta_segment_" + to_string(getpid());
+    string compacted = path + SEGMENT_COMPACT_SUFFIX;
+    unlink(path.c_str());
+    StateSegment segment;
+    ASSERT_TRUE(segment.attach(path, 1));
+
+    string data(400, 'x');
+    int stored = 0;
+    while (segment.store("asset-" + to_string(stored), data))
+        stored++;
+    ASSERT_GT(stored, 0);
+    ASSERT_TRUE(segment.compact());
+    ASSERT_NE(access(compacted.c_str(), F_OK), 0);
+    for (int i = stored; i < stored + 100; i++)
+        ASSERT_TRUE(segment.store("asset-" + to_string(i), data));
+
+    segment.detach();
+    ASSERT_TRUE(segment.attach(path, 1));
+    ASSERT_EQ(segment.getCount(), stored + 100);
+    const char *found;
+    size_t length;
+    ASSERT_TRUE(segment.lookup("asset-0", found, length));
+    ASSERT_EQ(string(found, length), data);
+
+    segment.detach();
+    unlink(path.c_str());
+}
+
+/* TEST CASE : A segment compacted in steps drops the assets removed while
+ * it was compacted, and a compaction is abandoned if the segment is
+ * otherwise changed
+ */
+TEST(DELTA, StateSegmentCompactionInSteps)
+{
+    string path = "/tmp/delta_segment_" + to_string(getpid());
+    string compacted = path + SEGMENT_COMPACT_SUFFIX;
+    unlink(path.c_str());
+    StateSegment segment;
+    ASSERT_TRUE(segment.attach(path, 1));
+    for (int i = 0; i < 1000; i++)
+        ASSERT_TRUE(segment.store("asset-" + to_string(i), "value"));
+
+    {
+        StateSegment::Compaction compaction;
+        segment.beginCompaction(compaction);
+        while (!segment.copyLive(compaction, 100))
+            segment.remove("asset-" + to_string(segment.getCount() - 1));
+        segment.remove("asset-0");
+        ASSERT_TRUE(StateSegment::writeCompaction(compaction));
+        ASSERT_TRUE(segment.installCompaction(compaction));
+    }
+    unsigned long count = segment.getCount();
+    ASSERT_LT(count, 999);
+    const char *found;
+    size_t length;
+    ASSERT_FALSE(segment.lookup("asset-0", found, length));
+    ASSERT_FALSE(segment.lookup("asset-" + to_string(count + 1), found, length));
+    ASSERT_TRUE(segment.lookup("asset-" + to_string(count), found, length));
+
+    {
+        StateSegment::Compaction compaction;
+        segment.beginCompaction(compaction);
+        ASSERT_TRUE(segment.copyLive(compaction, 8192));
+        ASSERT_TRUE(StateSegment::writeCompaction(compaction));
+        ASSERT_EQ(access(compacted.c_str(), F_OK), 0);
+        ASSERT_TRUE(segment.store("asset-0", "value"));
+        ASSERT_FALSE(segment.installCompaction(compaction));
+    }
+    ASSERT_NE(access(compacted.c_str(), F_OK), 0);
+    ASSERT_TRUE(segment.lookup("asset-0", found, length));
+
+    segment.detach();
+    ASSERT_TRUE(segment.attach(path, 1));
+    ASSERT_EQ(segment.getCount(), count + 1);
+    segment.detach();
+    unlink(path.c_str());
+}
+
+/* TEST CASE : The checkpoint thread compacts a state file that fills, and
+ * the state file it leaves may be attached to after a crash
+ */
+TEST(DELTA, StateFileCheckpointCompaction)
+{
+    string path = "/tmp/delta_state_" + to_string(getpid());
+    unlink(path.c_str());
+    ConfigCategory *config = createConfig(path, "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("checkpointInterval", "0.02");
+
+    // More assets than fit in the index of a new state file
+    int assets = SEGMENT_INITIAL_SLOTS;
+    DeltaFilter *filter = new DeltaFilter("delta", *config, NULL, NULL);
+    ASSERT_EQ(filterAssets(filter, 0, assets, 100.0), assets);
+    for (int i = 0; i < 500 && filter->getDirtyCount(); i++)
+        usleep(10000);
+    ASSERT_EQ(filter->getDirtyCount(), 0);
+    ASSERT_NE(access((path + SEGMENT_COMPACT_SUFFIX).c_str(), F_OK), 0);
+    string crashed = readFile(path);
+    delete filter;
+    writeFile(path, crashed);
+
+    filter = new DeltaFilter("delta", *config, NULL, NULL);
+    ASSERT_EQ(filterAssets(filter, 0, assets, 100.0), 0);
+    delete filter;
+
+    delete config;
+    unlink(path.c_str());
+}
+
+/* TEST CASE : Only the assets whose reference values change are written
+ * to the state file again, suppressed readings leave the state unchanged
+ */
+TEST(DELTA, StateFileUnchangedNotDirty)
+{
+    string path = "/tmp/delta_state_" + to_string(getpid());
+    unlink(path.c_str());
+    ConfigCategory *config = createConfig(path, "Include full reading if any Datapoint exceeds tolerance");
+
+    DeltaFilter *filter = new DeltaFilter("delta", *config, NULL, NULL);
+    ASSERT_EQ(filterAssets(filter, 0, 100, 100.0), 100);
+    ASSERT_EQ(filter->getDirtyCount(), 100);
+    filter->saveState();
+    ASSERT_EQ(filter->getDirtyCount(), 0);
+    delete filter;
+
+    filter = new DeltaFilter("delta", *config, NULL, NULL);
+    ASSERT_EQ(filterAssets(filter, 0, 100, 100.0), 0);
+    ASSERT_EQ(filter->getDirtyCount(), 0);
+    ASSERT_EQ(filterAssets(filter, 0, 10, 110.0), 10);
+    ASSERT_EQ(filter->getDirtyCount(), 10);
+    delete filter;
+
+    delete config;
+    unlink(path.c_str());
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <filter.h>
+#include <string.h>
+#include <string>
+#include <rapidjson/document.h>
+#include <reading.h>
+#include <reading_set.h>
+#include "helper.h"
+
+using namespace std;
+using namespace rapidjson;
+
+extern "C" {
+    PLUGIN_INFORMATION *plugin_info();
+    void plugin_ingest(void *handle,
+                   READINGSET *readingSet);
+    PLUGIN_HANDLE plugin_init(ConfigCategory* config,
+              OUTPUT_HANDLE *outHandle,
+              OUTPUT_STREAM output);
+    string plugin_shutdown(PLUGIN_HANDLE handle);
+    extern void Handler(void *handle, READINGSET *readings);
+};
+
+/**
+ * Ingest a single reading with an unchanging value for each of the assets
+ * and return the names of the assets that were forwarded
+ */
+static vector<string> ingestAssets(void *handle, ReadingSet **outReadings, const vector<string>& assets)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<string> dpNames = {"dp1"};
+    vector<double> dpValues = {100.0};
+    for (auto& asset : assets)
+        readings->emplace_back(createReadingWithDoubleDatapoints(asset, dpNames, dpValues));
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+
+    vector<string> forwarded;
+    for (auto rdng : (*outReadings)->getAllReadings())
+        forwarded.push_back(rdng->getAssetName());
+    delete *outReadings;
+    *outReadings = NULL;
+    return forwarded;
+}
+
+/**
+ * Ingest a single reading with the given datapoints, all with a value of
+ * 100, and timestamp in seconds and return the number of readings forwarded
+ */
+static int ingestTimed(void *handle, ReadingSet **outReadings, const string& asset,
+		const vector<string>& dpNames, long sec)
+{
+    vector<Reading *> *readings = new vector<Reading *>;
+    vector<double> dpValues(dpNames.size(), 100.0);
+    Reading *rdng = createReadingWithDoubleDatapoints(asset, dpNames, dpValues);
+    struct timeval tm = { 1700000000 + sec, 0 };
+    rdng->setUserTimestamp(tm);
+    readings->emplace_back(rdng);
+    ReadingSet *readingSet = new ReadingSet(readings);
+    readings->clear();
+    delete readings;
+    plugin_ingest(handle, (READINGSET *)readingSet);
+    int forwarded = (*outReadings)->getAllReadings().size();
+    delete *outReadings;
+    *outReadings = NULL;
+    return forwarded;
+}
+
+/* TEST CASE : Once the maximum number of assets is reached the least
+ * recently seen asset is evicted and treated as new when seen again
+ */
+TEST(DELTA, MaxAssetsEvictsLeastRecentlyUsed)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("maxAssets"), true);
+    config->setValue("maxAssets", "2");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"ast1", "ast2"}).size(), 2);
+
+    // ast1 is used more recently than ast2, so ast2 is evicted for ast3
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"ast1", "ast3"}), vector<string>({"ast3"}));
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"ast1", "ast3"}).size(), 0);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"ast2"}), vector<string>({"ast2"}));
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : The memory used to hold the state of assets is limited */
+TEST(DELTA, MaxStateSizeEvicts)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("maxStateSize"), true);
+    config->setValue("maxStateSize", "8");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    vector<string> assets;
+    for (int i = 0; i < 1000; i++)
+        assets.push_back("serial-" + to_string(i));
+    ASSERT_EQ(ingestAssets(handle, &outReadings, assets).size(), 1000);
+
+    // The most recent assets are still held, the oldest have been evicted
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"serial-999"}).size(), 0);
+    ASSERT_EQ(ingestAssets(handle, &outReadings, {"serial-0"}).size(), 1);
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : The state of an asset that has not been seen for longer than
+ * the expiry time is removed and the asset is treated as new
+ */
+TEST(DELTA, StateExpiryRemovesIdleAssets)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+
+    ASSERT_EQ(config->itemExists("stateExpiry"), true);
+    config->setValue("stateExpiry", "10");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast1", {"dp1"}, 0), 1);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast2", {"dp1"}, 0), 1);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast1", {"dp1"}, 5), 0);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast2", {"dp1"}, 12), 0);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast2", {"dp1"}, 20), 0);
+
+    // ast1 was last seen at 5 seconds and has expired, ast2 has not
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast1", {"dp1"}, 21), 1);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast2", {"dp1"}, 22), 0);
+
+    delete config;
+    plugin_shutdown(handle);
+}
+
+/* TEST CASE : A datapoint that disappears from the readings of an asset is
+ * removed from the reference values once it has not been seen for longer
+ * than the expiry time
+ */
+TEST(DELTA, StateExpiryRemovesStaleDatapoints)
+{
+    PLUGIN_INFORMATION *info = plugin_info();
+    ConfigCategory *config = new ConfigCategory("scale", info->config);
+    ASSERT_NE(config, (ConfigCategory *)NULL);
+    config->setItemsValueFromDefault();
+
+    config->setValue("toleranceMeasure", "Percentage");
+    config->setValue("tolerance", "1");
+    config->setValue("processingMode", "Include full reading if any Datapoint exceeds tolerance");
+    config->setValue("stateExpiry", "10");
+
+    config->setValue("enable", "true");
+
+    ReadingSet *outReadings;
+    void *handle = plugin_init(config, &outReadings, Handler);
+
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1", "dp2"}, 0), 1);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1"}, 5), 0);
+
+    // dp2 is still held, so is unchanged when it reappears
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1", "dp2"}, 8), 0);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1"}, 15), 0);
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1"}, 20), 0);
+
+    // dp2 has expired, so is new when it reappears
+    ASSERT_EQ(ingestTimed(handle, &outReadings, "ast", {"dp1", "dp2"}, 21), 1);
+
+    delete config;
+    plugin_shutdown(handle);
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <reading.h>
+#include <tracked_assets.h>
+#include "helper.h"
+
+using namespace std;
+
+/**
+ * Track the assets of a set of readings of the given assets and return
+ * those tracked for the first time
+ */
+static vector<string> trackAssets(TrackedAssets& tracked, const vector<string>& assets)
+{
+    vector<Reading *> readings;
+    for (const auto &asset : assets)
+        readings.push_back(createReadingWithDoubleDatapoints(asset, {"dp1"}, {1.0}));
+    vector<string> added;
+    tracked.track(readings, added);
+    for (auto reading : readings)
+        delete reading;
+    return added;
+}
+
+/* TEST CASE : Each asset is tracked once per configuration, however often
+ * it is seen, and is tracked again once the filter is reconfigured
+ */
+TEST(DELTA, TrackedAssetsOncePerConfiguration)
+{
+    TrackedAssets tracked;
+    ASSERT_EQ(trackAssets(tracked, {"pump", "valve", "pump"}), vector<string>({"pump", "valve"}));
+    ASSERT_EQ(trackAssets(tracked, {"valve", "pump", "tank"}), vector<string>({"tank"}));
+    ASSERT_EQ(trackAssets(tracked, {"tank", "pump"}).size(), 0);
+    ASSERT_EQ(tracked.size(), 3);
+
+    // A reconfiguration clears the assets tracked
+    tracked.clear();
+    ASSERT_EQ(tracked.size(), 0);
+    ASSERT_EQ(trackAssets(tracked, {"tank", "pump", "tank"}), vector<string>({"tank", "pump"}));
+    ASSERT_EQ(trackAssets(tracked, {"pump", "valve"}), vector<string>({"valve"}));
+    ASSERT_EQ(tracked.size(), 3);
+}
@@ -0,0 +1,165 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <timing_wheel.h>
+
+using namespace std;
+
+/**
+ * Remove the timer from the slot it is in, if any
+ */
+void
+TimingWheel::Timer::unlink()
+{
+	if (m_next)
+	{
+		m_prev->m_next = m_next;
+		m_next->m_prev = m_prev;
+		m_next = NULL;
+		m_prev = NULL;
+	}
+}
+
+/**
+ * Constructor for the timing wheel. Each slot is an empty circular
+ * list, i.e. a head that points to itself.
+ */
+TimingWheel::TimingWheel() : m_current(0)
+{
+	for (unsigned int level = 0; level < WHEEL_LEVELS; level++)
+	{
+		for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++)
+		{
+			m_slots[level][slot].m_next = &m_slots[level][slot];
+			m_slots[level][slot].m_prev = &m_slots[level][slot];
+		}
+	}
+}
+
+/**
+ * Destructor for the timing wheel. Any timers still in the wheel
+ * are detached, they are owned by the caller.
+ */
+TimingWheel::~TimingWheel()
+{
+	for (unsigned int level = 0; level < WHEEL_LEVELS; level++)
+	{
+		for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++)
+		{
+			Timer *head = &m_slots[level][slot];
+			while (head->m_next != head)
+				head->m_next->unlink();
+		}
+	}
+}
+
+/**
+ * Schedule a timer to expire at the given tick. If the timer is
+ * already scheduled it is moved. A timer whose expiry is not after
+ * the current tick will expire on the next tick.
+ *
+ * @param timer		The timer to schedule
+ * @param expiry	The tick at which the timer expires
+ */
+void
+TimingWheel::schedule(Timer *timer, uint64_t expiry)
+{
+	timer->unlink();
+	timer->m_expiry = expiry > m_current ? expiry : m_current + 1;
+	place(timer);
+}
+
+/**
+ * Place a timer in the slot that covers its expiry. Timers that expire
+ * on the current tick are only placed whilst cascading, before the
+ * current slot of level 0 is expired.
+ *
+ * @param timer	The timer to place
+ */
+void
+TimingWheel::place(Timer *timer)
+{
+	uint64_t expiry = timer->m_expiry;
+	if (expiry < m_current)
+		expiry = m_current;
+
+	uint64_t delta = expiry - m_current;
+	unsigned int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+		level++;
+	if (delta >= ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+	{
+		// Beyond the range of the wheel, it will be placed again when cascaded
+		expiry = m_current + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+
+	Timer *head = &m_slots[level][(expiry >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	timer->m_next = head;
+	timer->m_prev = head->m_prev;
+	head->m_prev->m_next = timer;
+	head->m_prev = timer;
+}
+
+/**
+ * Move all the timers in a slot down into the lower levels
+ *
+ * @param level	The level of the slot
+ * @param slot	The slot to cascade
+ */
+void
+TimingWheel::cascade(unsigned int level, unsigned int slot)
+{
+	Timer *head = &m_slots[level][slot];
+	if (head->m_next == head)
+		return;
+	Timer *timer = head->m_next;
+
+	// Detach the list from the slot before the timers are placed again
+	head->m_prev->m_next = NULL;
+	head->m_next = head;
+	head->m_prev = head;
+
+	while (timer)
+	{
+		Timer *next = timer->m_next;
+		place(timer);
+		timer = next;
+	}
+}
+
+/**
+ * Advance the wheel to the given tick, returning the timers that
+ * have expired. The expired timers are no longer scheduled.
+ *
+ * @param now		The current tick
+ * @param expired	Vector to which the expired timers are appended
+ */
+void
+TimingWheel::advance(uint64_t now, vector<Timer *>& expired)
+{
+	while (m_current < now)
+	{
+		m_current++;
+		if ((m_current & WHEEL_MASK) == 0)
+		{
+			for (unsigned int level = 1; level < WHEEL_LEVELS; level++)
+			{
+				unsigned int slot = (m_current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+				cascade(level, slot);
+				if (slot != 0)
+					break;
+			}
+		}
+		Timer *head = &m_slots[0][m_current & WHEEL_MASK];
+		while (head->m_next != head)
+		{
+			Timer *timer = head->m_next;
+			timer->unlink();
+			expired.push_back(timer);
+		}
+	}
+}
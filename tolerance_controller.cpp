@@ -0,0 +1,139 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <tolerance_controller.h>
+#include <logger.h>
+#include <math.h>
+
+/**
+ * Constructor for the tolerance controller
+ *
+ * @param interval	The time between readings at the target output rate
+ */
+ToleranceController::ToleranceController(const struct timeval& interval) :
+	m_interval(interval), m_bucketStart(0.0), m_start(-1.0), m_bucket(0),
+	m_changeTotal(0.0), m_changeCount(0), m_tolerance(0.0)
+{
+	double seconds = interval.tv_sec + ((double)interval.tv_usec / 1000000.0);
+	m_bucketLength = (seconds * BUDGET_WINDOW_INTERVALS) / BUDGET_BUCKETS;
+	for (int i = 0; i < BUDGET_BUCKETS; i++)
+		m_sent[i] = 0;
+}
+
+/**
+ * Return the tolerance to use for a reading with the given timestamp.
+ * If the reading falls beyond the current bucket of the sliding window
+ * the tolerance is adjusted before the window is moved on.
+ *
+ * @param tv		The timestamp of the reading
+ * @param configured	The tolerance configured for the asset
+ * @return The tolerance to use
+ */
+double
+ToleranceController::getTolerance(const struct timeval& tv, double configured)
+{
+	double now = tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+
+	if (m_start < 0.0)
+	{
+		m_start = now;
+		m_bucketStart = now;
+		m_tolerance = configured;
+	}
+	if (m_tolerance < configured)
+	{
+		m_tolerance = configured;
+	}
+
+	if (now >= m_bucketStart + m_bucketLength)
+	{
+		double bucketEnd = m_bucketStart + m_bucketLength;
+		double elapsed = bucketEnd - m_start;
+		if (elapsed > m_bucketLength * BUDGET_BUCKETS)
+			elapsed = m_bucketLength * BUDGET_BUCKETS;
+		adjust(elapsed, configured);
+
+		// Slide the window on, clearing the buckets we move into
+		unsigned long slide = (unsigned long)((now - m_bucketStart) / m_bucketLength);
+		for (unsigned long i = 0; i < slide && i < BUDGET_BUCKETS; i++)
+		{
+			m_bucket = (m_bucket + 1) % BUDGET_BUCKETS;
+			m_sent[m_bucket] = 0;
+		}
+		m_bucketStart += slide * m_bucketLength;
+	}
+	return m_tolerance;
+}
+
+/**
+ * Record the largest change seen in a reading. The average of these
+ * is used as the initial tolerance if the configured tolerance is zero
+ * and the output rate is too high.
+ *
+ * @param change	The largest change of any datapoint in the reading
+ */
+void
+ToleranceController::change(double change)
+{
+	if (isfinite(change))
+	{
+		m_changeTotal += change;
+		m_changeCount++;
+	}
+}
+
+/**
+ * Compare the output rate over the sliding window with the target rate
+ * and scale the tolerance accordingly. The scaling is the square root of
+ * the ratio of the two rates, limited to a factor of two in either
+ * direction, in order to damp the response of the controller. A dead band
+ * below the target rate avoids continual oscillation of the tolerance.
+ *
+ * @param elapsed	The time covered by the sliding window
+ * @param configured	The tolerance configured for the asset
+ */
+void
+ToleranceController::adjust(double elapsed, double configured)
+{
+	double interval = m_interval.tv_sec + ((double)m_interval.tv_usec / 1000000.0);
+	double expected = elapsed / interval;
+	if (expected <= 0.0)
+		return;
+
+	unsigned long sent = 0;
+	for (int i = 0; i < BUDGET_BUCKETS; i++)
+		sent += m_sent[i];
+
+	double ratio = sent / expected;
+	double previous = m_tolerance;
+	if (ratio > 1.0)
+	{
+		if (m_tolerance <= 0.0)
+		{
+			if (m_changeCount > 0)
+				m_tolerance = m_changeTotal / m_changeCount;
+		}
+		else
+		{
+			m_tolerance *= fmin(2.0, sqrt(ratio));
+		}
+	}
+	else if (ratio < 0.8)
+	{
+		m_tolerance *= fmax(0.5, sqrt(ratio));
+		if (m_tolerance < configured)
+			m_tolerance = configured;
+	}
+	m_changeTotal = 0.0;
+	m_changeCount = 0;
+
+	if (m_tolerance != previous)
+	{
+		Logger::getLogger()->debug("Output rate is %.2lf of target, tolerance adjusted from %lf to %lf",
+				ratio, previous, m_tolerance);
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ * Fledge "delta" filter plugin.
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <tracked_assets.h>
+
+using namespace std;
+
+/**
+ * Record the assets of a set of readings and return those that have not
+ * been tracked before
+ *
+ * @param readings	The readings whose assets are tracked
+ * @param added		Appended with the assets not tracked before, each once
+ */
+void
+TrackedAssets::track(const vector<Reading *>& readings, vector<string>& added)
+{
+	lock_guard<mutex> guard(m_mutex);
+	for (const auto &reading : readings)
+	{
+		const string& asset = reading->getAssetName();
+		if (m_assets.find(asset) == m_assets.end())
+		{
+			m_assets.insert(asset);
+			added.push_back(asset);
+		}
+	}
+}
+
+/**
+ * Forget the assets tracked, so that each is tracked again when it is
+ * next seen
+ */
+void
+TrackedAssets::clear()
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_assets.clear();
+}
+
+/**
+ * Return the number of assets tracked
+ */
+size_t
+TrackedAssets::size()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_assets.size();
+}